@@ -0,0 +1,197 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 4:20:53
+ */
+
+#include "output_ring.h"
+#include <algorithm>
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+
+namespace audio
+{
+
+void
+OutputRing::initialize(size_t blockBytes,
+                       int depth,
+                       int minPrefill,
+                       uint32_t shrinkBlocks)
+{
+    assert(blockBytes % sizeof(uint32_t) == 0);
+    assert(minPrefill >= 1 && minPrefill < depth);
+
+    blockWords_   = blockBytes / sizeof(uint32_t);
+    depth_        = depth;
+    minPrefill_   = minPrefill;
+    shrinkBlocks_ = shrinkBlocks;
+    buffer_.assign(blockWords_ * depth, 0);
+
+    written_.store(0);
+    read_.store(0);
+    released_.store(0);
+    prefill_.store(minPrefill);
+    writeSlot_ = 0;
+    readSlot_  = 0;
+
+    maxPrefill_    = minPrefill;
+    starved_       = false;
+    minReady_      = INT_MAX;
+    healthyBlocks_ = 0;
+    empty_         = 0;
+    underruns_     = 0;
+    shrinks_       = 0;
+
+    if (!events_)
+    {
+        events_ = xEventGroupCreate();
+    }
+}
+
+int
+OutputRing::getReadyCount() const
+{
+    return int(written_.load(std::memory_order_acquire) -
+               read_.load(std::memory_order_acquire));
+}
+
+bool
+OutputRing::isWritable() const
+{
+    auto w = written_.load(std::memory_order_relaxed);
+    return int(w - read_.load(std::memory_order_acquire)) <
+               prefill_.load(std::memory_order_relaxed) &&
+           int(w - released_.load(std::memory_order_acquire)) < depth_;
+}
+
+void*
+OutputRing::beginWrite()
+{
+    while (!isWritable())
+    {
+        // 消してから確かめるので、その後に進めば SPACE が立っている
+        xEventGroupClearBits(events_, SPACE);
+        if (!isWritable())
+        {
+            xEventGroupWaitBits(
+                events_, SPACE, pdTRUE, pdFALSE, portMAX_DELAY);
+        }
+    }
+    return &buffer_[writeSlot_ * blockWords_];
+}
+
+void
+OutputRing::endWrite()
+{
+    writeSlot_ = writeSlot_ + 1 == depth_ ? 0 : writeSlot_ + 1;
+    written_.fetch_add(1, std::memory_order_release);
+    xEventGroupSetBits(events_, DATA);
+}
+
+const void*
+OutputRing::beginRead(TickType_t wait)
+{
+    int ready = getReadyCount();
+    if (ready)
+    {
+        starved_ = false;
+        updateShrink(ready);
+    }
+    else
+    {
+        // 描画が始まる前は数えない
+        // 続けて空の間 (描画が 1 回止まった間) は 1 回だけ増やす
+        if (written_.load(std::memory_order_relaxed) && !starved_)
+        {
+            ++empty_;
+            grow();
+            starved_ = true;
+        }
+
+        xEventGroupClearBits(events_, DATA);
+        if (!getReadyCount())
+        {
+            xEventGroupWaitBits(events_, DATA, pdTRUE, pdFALSE, wait);
+        }
+        if (!getReadyCount())
+        {
+            ++underruns_;
+            return nullptr;
+        }
+    }
+
+    const auto* p = &buffer_[readSlot_ * blockWords_];
+    readSlot_     = readSlot_ + 1 == depth_ ? 0 : readSlot_ + 1;
+    read_.fetch_add(1, std::memory_order_release);
+    xEventGroupSetBits(events_, SPACE);
+    return p;
+}
+
+void
+OutputRing::endRead()
+{
+    released_.fetch_add(1, std::memory_order_release);
+    xEventGroupSetBits(events_, SPACE);
+}
+
+void
+OutputRing::grow()
+{
+    int p = std::min(prefill_.load(std::memory_order_relaxed) + 1, depth_ - 1);
+    prefill_.store(p, std::memory_order_relaxed);
+    maxPrefill_    = std::max(maxPrefill_, p);
+    minReady_      = INT_MAX;
+    healthyBlocks_ = 0;
+}
+
+void
+OutputRing::updateShrink(int ready)
+{
+    minReady_ = std::min(minReady_, ready);
+    if (++healthyBlocks_ < shrinkBlocks_)
+    {
+        return;
+    }
+
+    // 1 減らしても 1 ブロックは残っていたはず
+    int p = prefill_.load(std::memory_order_relaxed);
+    if (minReady_ >= 2 && p > minPrefill_)
+    {
+        prefill_.store(p - 1, std::memory_order_relaxed);
+        ++shrinks_;
+    }
+    minReady_      = INT_MAX;
+    healthyBlocks_ = 0;
+}
+
+OutputRing::Stats
+OutputRing::getStats() const
+{
+    Stats r;
+    r.depth      = depth_;
+    r.prefill    = prefill_.load(std::memory_order_relaxed);
+    r.maxPrefill = maxPrefill_;
+    r.minReady   = minReady_ == INT_MAX ? -1 : minReady_;
+    r.blocks     = read_.load(std::memory_order_relaxed);
+    r.empty      = empty_;
+    r.underruns  = underruns_;
+    r.shrinks    = shrinks_;
+    return r;
+}
+
+void
+OutputRing::print() const
+{
+    auto s = getStats();
+    printf("output ring: depth %d, prefill %d (max %d, shrink %u)\n",
+           s.depth,
+           s.prefill,
+           s.maxPrefill,
+           unsigned(s.shrinks));
+    printf("blocks %u, empty %u, underrun %u\n",
+           unsigned(s.blocks),
+           unsigned(s.empty),
+           unsigned(s.underruns));
+}
+
+} // namespace audio
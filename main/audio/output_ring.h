@@ -0,0 +1,107 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 4:2:26
+ */
+#ifndef _A37E08BB_99D5_4FD9_8ED5_5E5B012AD73F
+#define _A37E08BB_99D5_4FD9_8ED5_5E5B012AD73F
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+namespace audio
+{
+
+// 描画タスクと出力タスク (i2s_write) の間で変換済みのブロックを受け渡す
+// 描画側は prefill ブロック先まで描いたら出力されるのを待つ
+// 出力側は描けていなければ少し待ち、それでも無ければ無音を出す (underrun)
+//
+// prefill は出力するときにリングが空になったら 1 増やし、
+// shrinkBlocks の間空にならず常に 2 ブロック以上残っていれば 1 減らす
+// 統計の読み出しは表示用なので書き換え中でも気にしない
+class OutputRing
+{
+public:
+    // 128 サンプルのブロックで 10秒
+    static constexpr uint32_t DEFAULT_SHRINK_BLOCKS = 2500;
+
+    struct Stats
+    {
+        int depth;
+        int prefill;    // 今の目標
+        int maxPrefill; // これまでの最大
+        int minReady;   // 今の窓で出力時に残っていたブロック数の最小
+        uint32_t blocks;
+        uint32_t empty;     // 出力時に空になった (prefill を増やした) 回数
+        uint32_t underruns; // 待っても描けておらず無音を出した回数
+        uint32_t shrinks;
+    };
+
+private:
+    enum Event
+    {
+        SPACE = 1 << 0, // 出力側が進めた
+        DATA  = 1 << 1, // 描画側が進めた
+    };
+
+    std::vector<uint32_t> buffer_;
+    size_t blockWords_{};
+    int depth_{};
+    int minPrefill_{};
+    uint32_t shrinkBlocks_{};
+
+    std::atomic<uint32_t> written_{0};  // 描き終えたブロック数
+    std::atomic<uint32_t> read_{0};     // 出力側が取り出したブロック数
+    std::atomic<uint32_t> released_{0}; // 出力し終えて再び書けるブロック数
+    std::atomic<int> prefill_{0};
+    int writeSlot_{};
+    int readSlot_{};
+
+    // 以下は出力側のみが書く
+    int maxPrefill_{};
+    bool starved_{}; // 前回の出力時も空だった
+    int minReady_{};
+    uint32_t healthyBlocks_{};
+    uint32_t empty_{};
+    uint32_t underruns_{};
+    uint32_t shrinks_{};
+
+    EventGroupHandle_t events_{};
+
+public:
+    // blockBytes: 1 ブロックの大きさ (4 の倍数)
+    // depth: ブロック数、出力中の 1 ブロックがあるので prefill は depth - 1 まで
+    void initialize(size_t blockBytes,
+                    int depth,
+                    int minPrefill        = 1,
+                    uint32_t shrinkBlocks = DEFAULT_SHRINK_BLOCKS);
+
+    // 描画側
+    // 書き込むブロック、prefill 分先まで描けていれば出力が進むまで待つ
+    void* beginWrite();
+    void endWrite();
+    // 出力を待っているブロック数 (描いたブロックが出るまでの遅延)
+    int getReadyCount() const;
+
+    // 出力側
+    // 出力するブロック、wait [tick] 待っても描けていなければ nullptr
+    const void* beginRead(TickType_t wait);
+    // beginRead で得たブロックを出し終えた
+    void endRead();
+
+    Stats getStats() const;
+    void print() const;
+
+protected:
+    bool isWritable() const;
+    void grow();
+    void updateShrink(int ready);
+};
+
+} // namespace audio
+
+#endif /* _A37E08BB_99D5_4FD9_8ED5_5E5B012AD73F */
@@ -0,0 +1,166 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 2:31:8
+ */
+
+#include "upsampler.h"
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+namespace audio
+{
+
+namespace
+{
+
+inline int32_t
+saturate16(int32_t v)
+{
+    return std::min(std::max(v, int32_t(-32768)), int32_t(32767));
+}
+
+// 0次の第1種変形 Bessel 関数
+float
+besselI0(float x)
+{
+    float r = 1;
+    float t = 1;
+    for (int k = 1; k < 32; ++k)
+    {
+        t *= (x * 0.5f / k) * (x * 0.5f / k);
+        r += t;
+        if (t < r * 1e-9f)
+        {
+            break;
+        }
+    }
+    return r;
+}
+
+} // namespace
+
+void
+LinearUpsampler::process(int32_t* dst, const int32_t* src, size_t n)
+{
+    int32_t pv = prev_;
+    while (n)
+    {
+        int32_t v = saturate16(*src);
+        dst[0]    = (pv * 3 + v) >> 2;
+        dst[1]    = (pv + v) >> 1;
+        dst[2]    = (pv + v * 3) >> 2;
+        dst[3]    = v;
+
+        pv = v;
+        ++src;
+        dst += UPSAMPLE_FACTOR;
+        --n;
+    }
+    prev_ = pv;
+}
+
+template <int TAPS>
+void
+PolyphaseUpsampler<TAPS>::initialize(size_t maxSamples, float beta)
+{
+    static_assert(TAPS >= 2 && (TAPS & 1) == 0, "TAPS must be even");
+
+    // 長さ 4 * TAPS - 1 の sinc (零点は入力のサンプル間隔) に Kaiser 窓
+    // 最後の 1 タップは 0 にして 4 相に同じ数ずつ分ける
+    constexpr int L      = UPSAMPLE_FACTOR * TAPS - 1;
+    constexpr float c    = (L - 1) * 0.5f;
+    constexpr float pi   = 3.14159265f;
+    const float i0Beta   = besselI0(beta);
+    constexpr float gain = 1 << COEF_SHIFT;
+
+    for (int p = 0; p < UPSAMPLE_FACTOR; ++p)
+    {
+        float h[TAPS];
+        for (int k = 0; k < TAPS; ++k)
+        {
+            int j = p + k * UPSAMPLE_FACTOR;
+            if (j >= L)
+            {
+                h[k] = 0;
+                continue;
+            }
+            float t    = (j - c) / UPSAMPLE_FACTOR;
+            float sinc = t == 0 ? 1.0f : sinf(pi * t) / (pi * t);
+            float r    = (j - c) / c;
+            h[k]       = sinc * besselI0(beta * sqrtf(1 - r * r)) / i0Beta;
+        }
+
+        // 相ごとに直流の利得を 1 にそろえる (揃わないと直流が入力の
+        // サンプリング周波数の像になる)
+        float sum = 0;
+        for (float v : h)
+        {
+            sum += v;
+        }
+        int isum  = 0;
+        int maxK  = 0;
+        auto& dst = coefs_[p];
+        for (int k = 0; k < TAPS; ++k)
+        {
+            dst[k] = int16_t(lroundf(h[k] / sum * gain));
+            isum += dst[k];
+            maxK = fabsf(h[k]) > fabsf(h[maxK]) ? k : maxK;
+        }
+        dst[maxK] += int16_t(int(gain) - isum);
+    }
+
+    work_.assign(maxSamples + TAPS - 1, 0);
+}
+
+template <int TAPS>
+void
+PolyphaseUpsampler<TAPS>::clear()
+{
+    std::fill(work_.begin(), work_.end(), 0);
+}
+
+template <int TAPS>
+void
+PolyphaseUpsampler<TAPS>::process(int32_t* dst, const int32_t* src, size_t n)
+{
+    assert(n + TAPS - 1 <= work_.size());
+
+    // x[i - k] で k サンプル前を参照できるように前回の続きに並べる
+    int32_t* x = work_.data() + TAPS - 1;
+    for (size_t i = 0; i < n; ++i)
+    {
+        x[i] = saturate16(src[i]);
+    }
+
+    constexpr int32_t ROUND = 1 << (COEF_SHIFT - 1);
+    for (size_t i = 0; i < n; ++i)
+    {
+        const int32_t* xi = x + i;
+        for (int p = 0; p < UPSAMPLE_FACTOR; ++p)
+        {
+            if (p == THROUGH_PHASE)
+            {
+                dst[p] = xi[-THROUGH_TAP];
+                continue;
+            }
+
+            const auto& h = coefs_[p];
+            int32_t acc   = ROUND;
+            for (int k = 0; k < TAPS; ++k)
+            {
+                acc += h[k] * xi[-k];
+            }
+            dst[p] = saturate16(acc >> COEF_SHIFT);
+        }
+        dst += UPSAMPLE_FACTOR;
+    }
+
+    std::copy(x + n - (TAPS - 1), x + n, work_.begin());
+}
+
+template class PolyphaseUpsampler<4>;
+template class PolyphaseUpsampler<8>;
+template class PolyphaseUpsampler<16>;
+
+} // namespace audio
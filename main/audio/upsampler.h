@@ -0,0 +1,67 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 2:14:37
+ */
+#ifndef _39F54A10_43F7_431B_9C98_7CB1CEBF0CCB
+#define _39F54A10_43F7_431B_9C98_7CB1CEBF0CCB
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace audio
+{
+
+// 内蔵 DAC 用の 4倍アップサンプラ
+// 入出力は 0 中心の 16bit の範囲 (外れたものは飽和させる)
+// process の出力は入力の FACTOR 倍のサンプル数
+constexpr int UPSAMPLE_FACTOR = 4;
+
+// 前後のサンプルを 3/4, 1/2, 1/4 で直線補間する
+class LinearUpsampler
+{
+    int32_t prev_{};
+
+public:
+    void initialize(size_t /*maxSamples*/) { clear(); }
+    void clear() { prev_ = 0; }
+
+    void process(int32_t* dst, const int32_t* src, size_t n);
+};
+
+// Kaiser 窓で設計した FIR を多相分解した補間
+// 遮断は入力の Nyquist 周波数で、4 相のうち 1 相は元のサンプルそのものになる
+// (ゼロを挿入した列に対する Nyquist フィルタ、半帯域フィルタの 4倍版)
+// TAPS: 1相あたりのタップ数、遅延は 2 * TAPS - 1 出力サンプル
+template <int TAPS>
+class PolyphaseUpsampler
+{
+public:
+    static constexpr int COEF_SHIFT = 14;
+
+    // pm_report upsample で 1-12kHz の像が最も小さくなるものを選んだ
+    static constexpr float getDefaultKaiserBeta()
+    {
+        return TAPS <= 4 ? 3.0f : TAPS <= 8 ? 5.0f : 6.0f;
+    }
+
+private:
+    // 元のサンプルがそのまま出る相とそのタップ
+    static constexpr int THROUGH_PHASE = UPSAMPLE_FACTOR - 1;
+    static constexpr int THROUGH_TAP   = TAPS / 2 - 1;
+
+    // [相][k] は k サンプル前の入力に掛ける
+    std::array<std::array<int16_t, TAPS>, UPSAMPLE_FACTOR> coefs_{};
+    std::vector<int32_t> work_; // 前回の最後の TAPS - 1 サンプル + 今回の入力
+
+public:
+    void initialize(size_t maxSamples, float beta = getDefaultKaiserBeta());
+    void clear();
+
+    void process(int32_t* dst, const int32_t* src, size_t n);
+};
+
+} // namespace audio
+
+#endif /* _39F54A10_43F7_431B_9C98_7CB1CEBF0CCB */
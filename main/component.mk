@@ -1,4 +1,21 @@
 CXXFLAGS += -std=c++1z -O3
-COMPONENT_SRCDIRS := . io system pm_piano graphics
+COMPONENT_SRCDIRS := . audio io system pm_piano graphics
 COMPONENT_ADD_INCLUDEDIRS := .
-COMPONENT_EMBED_FILES := kb_mini.bmp
\ No newline at end of file
+
+# 既定の SystemParameters の Note の係数表を host で作って埋め込む
+# (tools/gen_note_table.cpp、pm_piano を変えれば作り直す)
+HOST_CXX ?= g++
+NOTE_TABLE := $(COMPONENT_BUILD_DIR)/note_table.bin
+NOTE_TABLE_GEN := $(COMPONENT_BUILD_DIR)/gen_note_table
+NOTE_TABLE_SRCS := $(PROJECT_PATH)/tools/gen_note_table.cpp \
+	$(addprefix $(COMPONENT_PATH)/pm_piano/,allocator.cpp filter.cpp \
+	hammer.cpp note.cpp note_table.cpp string.cpp sys_params.cpp)
+
+COMPONENT_EMBED_FILES := kb_mini.bmp $(NOTE_TABLE)
+COMPONENT_EXTRA_CLEAN := $(NOTE_TABLE) $(NOTE_TABLE_GEN)
+
+$(NOTE_TABLE_GEN): $(NOTE_TABLE_SRCS) $(wildcard $(COMPONENT_PATH)/pm_piano/*.h)
+	$(HOST_CXX) -std=c++1z -O2 -I$(COMPONENT_PATH) $(NOTE_TABLE_SRCS) -o $@
+
+$(NOTE_TABLE): $(NOTE_TABLE_GEN)
+	$(NOTE_TABLE_GEN) $@
@@ -5,6 +5,7 @@
 
 #include "ble_midi.h"
 #include "../debug.h"
+#include <system/util.h>
 
 #define ENABLE_DEBUG_PRINT 1
 
@@ -83,6 +84,9 @@ BLEMidiClient::onNotify(const uint8_t* p, size_t size, int handle)
 {
     if (handle == handle_ && midiIn_)
     {
+        // 遅延計測用の到着時刻
+        auto arrivalTime = sys::micros();
+
         DB(("Midi in: handle %d, %zd bytes.\n", handle, size));
 
         if (size < 3)
@@ -91,14 +95,16 @@ BLEMidiClient::onNotify(const uint8_t* p, size_t size, int handle)
             return;
         }
 
-        auto process = [this](int timeH,
-                              int timeL,
-                              const uint8_t* top,
-                              const uint8_t* bottom) {
+        auto process = [this, arrivalTime](int timeH,
+                                           int timeL,
+                                           const uint8_t* top,
+                                           const uint8_t* bottom) {
             DB(("time %d\n", timeL | (timeH << 7)));
             midiInMessageMaker_.analyze(
-                top, bottom, [this](const MidiMessage& m) {
-                    midiIn_->put(m);
+                top, bottom, [this, arrivalTime](const MidiMessage& m) {
+                    auto tm      = m;
+                    tm.timestamp = arrivalTime;
+                    midiIn_->put(tm);
                     m.dump();
                 });
         };
@@ -5,6 +5,7 @@
 
 #include "midi.h"
 #include <assert.h>
+#include <system/trace.h>
 
 namespace io
 {
@@ -79,8 +80,14 @@ MidiMessageQueue::put(const MidiMessage& m)
 {
     if (queue_.getSpace())
     {
+        TRACE_INSTANT(MIDI_PUT, m.data[0] << 8 | m.data[1]);
         queue_.push(m);
     }
+    else if (queue_.isEnabled())
+    {
+        TRACE_INSTANT(MIDI_DROP, m.data[0] << 8 | m.data[1]);
+        dropCount_.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
 void
@@ -7,6 +7,7 @@
 
 #include "../debug.h"
 #include <array>
+#include <atomic>
 #include <debug.h>
 #include <system/queue.h>
 
@@ -17,6 +18,7 @@ struct MidiMessage
 {
     uint8_t size{};
     std::array<uint8_t, 3> data{};
+    uint32_t timestamp{}; // 受信時刻 [us] (sys::micros)、0 なら不明
 
     // System Exclusiv は3byteずつ複数の MidiMessage に分割する
     // 途中に挟まるRealtime系は分離する
@@ -54,6 +56,7 @@ class MidiMessageQueue : public MidiIn, public MidiOut
 {
     using Queue = sys::QueueWithSwitch<MidiMessage>;
     Queue queue_;
+    std::atomic<uint32_t> dropCount_{0};
 
 public:
     MidiMessageQueue(size_t queueSize = 16);
@@ -62,6 +65,9 @@ public:
 
     void put(const MidiMessage& m);
     void setActive(bool f); // 消費先に接続するときに有効にする
+
+    // 有効なのに一杯で捨てたメッセージの数
+    uint32_t getDropCount() const { return dropCount_; }
 };
 
 /////
@@ -6,10 +6,17 @@
 
 #include <pm_piano/piano.h>
 
+#include <audio/output_ring.h>
+#include <audio/upsampler.h>
+
 #include <graphics/bmp.h>
 #include <util/binary.h>
 
 #include <graphics/framebuffer.h>
+#include <system/nvs.h>
+#include <system/realtime_monitor.h>
+#include <system/trace.h>
+#include <system/util.h>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
@@ -17,26 +24,53 @@
 
 #include <driver/i2s.h>
 
+#include <algorithm>
 #include <memory>
 
 DEF_LINKED_BINARY(kb_mini_bmp);
+DEF_LINKED_BINARY(note_table_bin); // 既定の設定の Note の係数 (component.mk)
 
 namespace
 {
 
 io::MidiMessageQueue midiIn_;
 physical_modeling_piano::Piano piano_;
+sys::RealtimeMonitor monitor_;
 
 #define DELTA_SIGMA 1
 
-constexpr size_t sampleFreq =
-    physical_modeling_piano::SystemParameters::sampleRate;
+// 内蔵 DAC (DELTA_SIGMA 0) の 4倍補間
+// 0: 直線補間、4/8/16: 多相 FIR の 1相あたりのタップ数 (pm_report upsample)
+#define DAC_UPSAMPLE_TAPS 8
+
+// 起動時にボタンで選ぶ (selectSampleRate)
+uint32_t sampleFreq = physical_modeling_piano::DEFAULT_SAMPLE_RATE;
 
 constexpr int overSampleShiftDeltaSigma = 1;
 constexpr int overSampleShift           = 2;
 
 static constexpr size_t UNIT_SAMPLES = 128;
 
+// DMA のブロック数はサンプリング周波数から決める (computeDMABufCount)
+int dmaBufCount = 4;
+
+// i2s_write は DMA が空くまで待つので、書き込む時点で DMA は埋まっている
+uint32_t dmaDepthSamples = 4 * UNIT_SAMPLES;
+
+#if DELTA_SIGMA
+using OutputWord = uint32_t;
+constexpr size_t OUTPUT_BLOCK_WORDS = UNIT_SAMPLES << overSampleShiftDeltaSigma;
+#else
+using OutputWord = uint16_t; // L/R
+constexpr size_t OUTPUT_BLOCK_WORDS = (UNIT_SAMPLES << overSampleShift) << 1;
+#endif
+constexpr size_t OUTPUT_BLOCK_BYTES = OUTPUT_BLOCK_WORDS * sizeof(OutputWord);
+
+// 描画と DMA の間に置くブロック数
+// 描き溜める数 (prefill) は underrun しそうになると増え、余裕があると減る
+constexpr int OUTPUT_RING_DEPTH = 8;
+audio::OutputRing outputRing_;
+
 } // namespace
 
 struct Encoder
@@ -159,7 +193,7 @@ getSample()
 
     constexpr float _2pi = 3.1415926535f * 2;
     constexpr float freq = 440;
-    constexpr float dt   = freq / sampleFreq * _2pi;
+    const float dt       = freq / sampleFreq * _2pi;
 
     t += dt;
     if (t > _2pi)
@@ -200,7 +234,7 @@ initIO()
         cfg.communication_format =
             i2s_comm_format_t(I2S_COMM_FORMAT_I2S | I2S_COMM_FORMAT_I2S_MSB);
         cfg.intr_alloc_flags = 0;
-        cfg.dma_buf_count    = 4;
+        cfg.dma_buf_count    = dmaBufCount;
         cfg.dma_buf_len      = UNIT_SAMPLES << overSampleShiftDeltaSigma;
         cfg.use_apll         = false;
 
@@ -231,7 +265,7 @@ initIO()
     cfg.channel_format       = I2S_CHANNEL_FMT_RIGHT_LEFT;
     cfg.communication_format = i2s_comm_format_t(I2S_COMM_FORMAT_I2S_MSB);
     cfg.intr_alloc_flags     = 0;
-    cfg.dma_buf_count        = 4;
+    cfg.dma_buf_count        = dmaBufCount;
     cfg.dma_buf_len          = UNIT_SAMPLES << overSampleShift;
     cfg.use_apll             = false;
 
@@ -243,93 +277,157 @@ initIO()
 #endif
 }
 
-void
-soundTask(void*)
-{
 #if DELTA_SIGMA
-    Encoder encL;
-    while (1)
+// 響板の出力を 2倍にオーバーサンプルして ΔΣ のワード列にする
+class DeltaSigmaSink : public physical_modeling_piano::OutputSink
+{
+    Encoder encoder_;
+    uint32_t* dst_{};
+
+public:
+    void initialize() {}
+    void begin(uint32_t* dst) { dst_ = dst; }
+
+    // 無音 (32768) は毎回同じワードになりエンコーダの状態も変わらない
+    void fillSilence(uint32_t* dst, size_t n)
+    {
+        std::fill(dst, dst + n, encoder_.encode(32768));
+    }
+
+    void write(const int32_t* samples, size_t n) override
     {
-        static int32_t samples[UNIT_SAMPLES];
-        memset(samples, 0, sizeof(samples));
-        piano_.update(samples, UNIT_SAMPLES, midiIn_);
-
-        static uint32_t out[UNIT_SAMPLES << overSampleShiftDeltaSigma];
-        auto* dst = out;
-        auto* src = samples;
-        for (int i = 0; i < UNIT_SAMPLES; ++i)
+        auto* dst = dst_;
+        while (n)
         {
-            auto v = *src + 32768;
-            dst[0] = encL.encode(v);
-            dst[1] = encL.encode(v);
-            src += 1;
+            auto v = *samples + 32768;
+            dst[0] = encoder_.encode(v);
+            dst[1] = encoder_.encode(v);
+            ++samples;
             dst += 2;
+            --n;
         }
-
-        size_t writeBytes;
-        i2s_write(I2S_NUM_0, out, sizeof(out), &writeBytes, portMAX_DELAY);
-        //        i2s_write(I2S_NUM_1, out, sizeof(out), &writeBytes,
-        //        portMAX_DELAY);
+        dst_ = dst;
     }
+};
 #else
-    static int32_t samples[UNIT_SAMPLES];
-    static uint16_t pcm[((UNIT_SAMPLES << overSampleShift) << 1)];
-    int residual = 0;
-    int pv       = 32768;
+// 響板の出力を 4倍に補間して内蔵 DAC の 8bit にする
+class DacSink : public physical_modeling_piano::OutputSink
+{
+    static_assert((1 << overSampleShift) == audio::UPSAMPLE_FACTOR, "");
 
-    while (1)
+#if DAC_UPSAMPLE_TAPS
+    audio::PolyphaseUpsampler<DAC_UPSAMPLE_TAPS> upsampler_;
+#else
+    audio::LinearUpsampler upsampler_;
+#endif
+    int32_t upsampled_[UNIT_SAMPLES << overSampleShift];
+    int residual_{};
+    uint16_t* dst_{};
+
+public:
+    void initialize() { upsampler_.initialize(UNIT_SAMPLES); }
+    void begin(uint16_t* dst) { dst_ = dst; }
+
+    // 無音なら補間の履歴も 0 なので量子化誤差も変わらない
+    void fillSilence(uint16_t* dst, size_t n)
     {
-        memset(samples, 0, sizeof(samples));
-        piano_.update(samples, UNIT_SAMPLES, midiIn_);
+        std::fill(dst, dst + n, 32768);
+        upsampler_.clear();
+    }
 
-        const auto* src = samples;
-        auto* dst       = pcm;
-        int ct          = UNIT_SAMPLES;
-        do
-        {
-            int v = *src + 32768;
+    void write(const int32_t* samples, size_t n) override
+    {
+        upsampler_.process(upsampled_, samples, n);
 
-#if 0
-            dst[0] = v;
-            dst[1] = v;
-            ++src;
-            dst += 2;
-#else
-            int v0   = ((pv * 3 + v) >> 2) + residual;
-            int vq   = v0 & 0xff00;
-            residual = v0 - vq;
+        // DAC は 8bit なので量子化誤差を次のサンプルに回す
+        auto* dst     = dst_;
+        auto residual = residual_;
+        for (size_t i = 0; i < (n << overSampleShift); ++i)
+        {
+            int v    = upsampled_[i] + 32768 + residual;
+            int vq   = v & 0xff00;
+            residual = v - vq;
             dst[0]   = vq;
             dst[1]   = vq;
+            dst += 2;
+        }
+        dst_      = dst;
+        residual_ = residual;
+    }
+};
+#endif
 
-            int v1   = ((pv + v) >> 1) + residual;
-            vq       = v1 & 0xff00;
-            residual = v1 - vq;
-            dst[2]   = vq;
-            dst[3]   = vq;
-
-            int v2   = ((pv + v * 3) >> 2) + residual;
-            vq       = v2 & 0xff00;
-            residual = v2 - vq;
-            dst[4]   = vq;
-            dst[5]   = vq;
-
-            int v3   = v + residual;
-            vq       = v3 & 0xff00;
-            residual = v3 - vq;
-            dst[6]   = vq;
-            dst[7]   = vq;
-
-            src += 1;
-            dst += 8;
-            pv = v;
+// 描画してリングに積む
+void
+soundTask(void*)
+{
+    // 変換は響板の最後の処理と一緒に Piano::update の中で行う
+    // RealtimeMonitor の ENCODE は無音のときの埋め合わせだけになる
+#if DELTA_SIGMA
+    static DeltaSigmaSink sink;
+#else
+    static DacSink sink;
 #endif
-        } while (--ct);
+    sink.initialize();
 
-        size_t writeBytes;
-        i2s_write(I2S_NUM_0, pcm, sizeof(pcm), &writeBytes, portMAX_DELAY);
+    while (1)
+    {
+        auto tw   = sys::micros();
+        auto* out = static_cast<OutputWord*>(outputRing_.beginWrite());
+        sink.begin(out);
+
+        auto t0       = sys::micros();
+        bool sounding = piano_.update(sink, UNIT_SAMPLES, midiIn_);
+        auto t1       = sys::micros();
+        if (!sounding)
+        {
+            sink.fillSilence(out, OUTPUT_BLOCK_WORDS);
+        }
+        auto t2 = sys::micros();
+
+        // リングで待っている分の後に、DMA に積まれている分が続く
+        piano_.getLatencyProbe().blockEncoded(
+            t2, dmaDepthSamples + outputRing_.getReadyCount() * UNIT_SAMPLES);
+        outputRing_.endWrite();
+        monitor_.recordBlock(t1 - t0, t2 - t1, t0 - tw);
     }
+}
 
+// リングから DMA へ
+// 描画が間に合わなければ、DMA に残っている分が出終わる前に無音を入れる
+void
+outputTask(void*)
+{
+    static OutputWord silence[OUTPUT_BLOCK_WORDS];
+#if DELTA_SIGMA
+    std::fill(std::begin(silence), std::end(silence), 0xaaaaaaaa); // 50%
+#else
+    std::fill(std::begin(silence), std::end(silence), 32768);
 #endif
+
+    // i2s_write から戻った時点で DMA にはまだ dmaBufCount - 1 ブロックある
+    // 1 ブロック分残して待つ (tick が粗いので最低 1 tick、それでも DMA が
+    // 空にならないように dmaBufCount を決めてある)
+    const TickType_t underrunWait = std::max<TickType_t>(
+        pdMS_TO_TICKS((dmaBufCount - 2) * UNIT_SAMPLES * 1000 / sampleFreq),
+        1);
+
+    while (1)
+    {
+        auto* p = outputRing_.beginRead(underrunWait);
+
+        size_t writeBytes;
+        i2s_write(I2S_NUM_0,
+                  p ? p : silence,
+                  OUTPUT_BLOCK_BYTES,
+                  &writeBytes,
+                  portMAX_DELAY);
+        //        i2s_write(I2S_NUM_1, ...);
+        if (p)
+        {
+            outputRing_.endRead();
+        }
+    }
 }
 
 class KeyboardDisp
@@ -423,6 +521,51 @@ public:
     }
 };
 
+// 起動時に押しているボタンでサンプリング周波数を選ぶ
+// A: 44.1kHz (音質優先)、B: 22.05kHz (同時発音数優先)、無し: 既定
+uint32_t
+selectSampleRate()
+{
+    M5.update();
+    if (M5.BtnA.isPressed())
+    {
+        return 44100;
+    }
+    if (M5.BtnB.isPressed())
+    {
+        return 22050;
+    }
+    return physical_modeling_piano::DEFAULT_SAMPLE_RATE;
+}
+
+// i2s_write から戻った時点で DMA に残る (n - 1) ブロックが、outputTask が
+// 無音に切り替えるまでの最短の待ち (1 tick) に 1ms の余裕を足したより長い数
+// 32kHz (tick 10ms) では 4、44.1kHz/48kHz では 5/6、22.05kHz では 3
+int
+computeDMABufCount(uint32_t fs)
+{
+    const uint32_t waitUs  = portTICK_PERIOD_MS * 1000 + 1000;
+    const uint32_t blockUs = UNIT_SAMPLES * 1000000 / fs;
+    return (waitUs + blockUs - 1) / blockUs + 1;
+}
+
+// 埋め込みの表が合わないとき (既定以外のサンプリング周波数) に
+// 計算した表を NVS に置いて次の起動から使う
+class NVSNoteTableStorage : public physical_modeling_piano::NoteTableStorage
+{
+public:
+    bool load(std::vector<uint8_t>& table) override
+    {
+        return sys::readNVSBlob("pm_piano", "note_table", table);
+    }
+
+    bool save(const std::vector<uint8_t>& table) override
+    {
+        return sys::writeNVSBlob(
+            "pm_piano", "note_table", table.data(), table.size());
+    }
+};
+
 extern "C" void
 app_main()
 {
@@ -437,6 +580,15 @@ app_main()
     M5.Lcd.setTextColor(0xffff);
     M5.Lcd.print("M5 PM PIANO");
 
+    sampleFreq = selectSampleRate();
+    DBOUT(("sample rate %dHz\n", int(sampleFreq)));
+    M5.Lcd.setCursor(160 - 6 * 7 - 4, 2);
+    M5.Lcd.printf("%5dHz", int(sampleFreq));
+
+    dmaBufCount     = computeDMABufCount(sampleFreq);
+    dmaDepthSamples = dmaBufCount * UNIT_SAMPLES;
+    DBOUT(("dma %d blocks.\n", dmaBufCount));
+
     KeyboardDisp kbDisp;
     kbDisp.initialize();
 
@@ -456,11 +608,23 @@ app_main()
     midiIn_.setActive(true);
 
     DBOUT(("piano = %dbytes.\n", sizeof(piano_)));
-    piano_.initialize(10);
-
+    // 既定のサンプリング周波数以外では埋め込みの表が合わないので
+    // NVS の表を使い、それも合わなければ計算して NVS に置く
+    static NVSNoteTableStorage noteTableStorage;
+    piano_.setNoteTable(GET_LINKED_BINARY(note_table_bin),
+                        GET_LINKED_BINARY_SIZE(note_table_bin));
+    piano_.setNoteTableStorage(&noteTableStorage);
+    piano_.initialize(16, 64 * 1024, UNIT_SAMPLES, sampleFreq);
+    monitor_.initialize(UNIT_SAMPLES, sampleFreq);
+    // 30 ブロックくらい
+    sys::TraceRecorder::instance().initialize(1024);
+
+    outputRing_.initialize(OUTPUT_BLOCK_BYTES, OUTPUT_RING_DEPTH);
     initIO();
 
     xTaskCreate(&soundTask, "sound_task", 2048 + 1024, NULL, 15, NULL);
+    xTaskCreate(&outputTask, "output_task", 2048, NULL, 16, NULL);
+    DBOUT(("playable %u ms after boot.\n", unsigned(sys::millis())));
 
     bool connected = false;
 
@@ -490,12 +654,44 @@ app_main()
 
         kbDisp.update();
 
+        // A ボタンで処理時間とノートオンの遅延の集計を出す
+        M5.update();
+        if (M5.BtnA.wasPressed())
+        {
+            monitor_.print();
+            outputRing_.print();
+            printf("midi drop %u\n", unsigned(midiIn_.getDropCount()));
+            piano_.getLatencyProbe().print();
+        }
+
+        // B ボタンでトレースの記録開始、もう一度押すと JSON をシリアルに出す
+        if (M5.BtnB.wasPressed())
+        {
+            auto& trace = sys::TraceRecorder::instance();
+            if (trace.isEnabled())
+            {
+                trace.writeChromeJSON(stdout);
+            }
+            else
+            {
+                trace.clear();
+                trace.setEnabled(true);
+            }
+        }
+
         int v = M5.Axp.GetVbatData();
         M5.Lcd.setTextColor(graphics::makeColor(168, 168, 168), 0);
         M5.Lcd.setCursor(160 - 6 * 6, 14);
         M5.Lcd.printf("%d.%03dV", v / 1000, v % 1000);
         M5.Lcd.setCursor(2, 14);
         M5.Lcd.printf("Voice:%zd ", piano_.getCurrentNoteCount());
+        // 周期を超えたブロックがあれば赤くする
+        M5.Lcd.setTextColor(monitor_.getOverrunCount()
+                                ? graphics::makeColor(255, 64, 64)
+                                : graphics::makeColor(168, 168, 168),
+                            0);
+        M5.Lcd.setCursor(2 + 6 * 10, 14);
+        M5.Lcd.printf("CPU:%d%% ", monitor_.getLoadPercent());
 
         delay(1);
     }
@@ -34,8 +34,25 @@ SimpleLinearAllocator::allocate(size_t size, size_t align)
 void
 PoolAllocator::initialize(size_t unitSize, size_t n)
 {
-    buffer_.resize(unitSize * n);
+    ownBuffer_.resize(computeBufferSize(unitSize, n) / sizeof(uint32_t));
+    initialize(ownBuffer_.data(), unitSize, n);
+}
+
+void
+PoolAllocator::initialize(void* buffer, size_t unitSize, size_t n)
+{
+    assert(unitSize % sizeof(uint32_t) == 0);
+    assert((reinterpret_cast<uintptr_t>(buffer) & 3) == 0);
+
+    buffer_   = static_cast<uint32_t*>(buffer);
     unitSize_ = unitSize;
+    n_        = n;
+
+    if (!n)
+    {
+        freeTop_ = 0xffffffff;
+        return;
+    }
 
     for (size_t i = 0; i < n - 1; ++i)
     {
@@ -63,11 +80,11 @@ PoolAllocator::allocate()
 void
 PoolAllocator::free(void* p)
 {
-    auto p0  = reinterpret_cast<char*>(buffer_.data());
+    auto p0  = reinterpret_cast<char*>(buffer_);
     auto pp  = reinterpret_cast<char*>(p);
     auto idx = (pp - p0) / unitSize_;
-    assert(pp - p0 <= buffer_.size());
     assert(pp >= p0);
+    assert(size_t(pp - p0) < computeBufferSize(unitSize_, n_));
     assert(p0 + idx * unitSize_ == p);
     *reinterpret_cast<uint32_t*>(p) = freeTop_;
     freeTop_                        = idx;
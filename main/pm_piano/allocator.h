@@ -27,18 +27,35 @@ public:
 
 class PoolAllocator
 {
-    std::vector<uint32_t> buffer_;
+    std::vector<uint32_t> ownBuffer_;
+    uint32_t* buffer_{};
     size_t unitSize_{};
-    uint32_t freeTop_{};
+    size_t n_{};
+    uint32_t freeTop_{0xffffffff};
 
 public:
     PoolAllocator() = default;
     PoolAllocator(size_t unitSize, size_t n) { initialize(unitSize, n); }
     void initialize(size_t unitSize, size_t n);
+    // 外部のメモリ (4byte 境界、computeBufferSize 以上) を使う
+    void initialize(void* buffer, size_t unitSize, size_t n);
     void* allocate();
     void free(void* p);
 
     size_t getUnitSize() const { return unitSize_; }
+    size_t getUnitCount() const { return n_; }
+
+    bool contains(const void* p) const
+    {
+        auto pp = static_cast<const uint8_t*>(p);
+        auto p0 = reinterpret_cast<const uint8_t*>(buffer_);
+        return pp >= p0 && pp < p0 + computeBufferSize(unitSize_, n_);
+    }
+
+    static size_t computeBufferSize(size_t unitSize, size_t n)
+    {
+        return unitSize * n;
+    }
 
 protected:
     uint32_t* getUnit(size_t i);
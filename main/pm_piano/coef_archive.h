@@ -0,0 +1,165 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 5:12:40
+ */
+#ifndef _3381141F_92B1_4432_9F28_7ABB16FD4B54
+#define _3381141F_92B1_4432_9F28_7ABB16FD4B54
+
+#include "fixed.h"
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+
+namespace physical_modeling_piano
+{
+
+// 係数をバイト列に書き出す / 読み戻す
+// 各クラスの serializeCoefficients(ar) で同じ順に ar(メンバ) を呼ぶ
+// FixedPoint は生の値、float はビット列、整数はそのまま 32bit のワードにして
+// 符号を下位に移した 7bit ずつの可変長で書く (係数の殆どは 16bit に収まる)
+namespace detail
+{
+
+inline uint32_t
+toCoefWord(float v)
+{
+    uint32_t w;
+    memcpy(&w, &v, sizeof(w));
+    return w;
+}
+
+template <class T, int S>
+inline uint32_t
+toCoefWord(const FixedPoint<T, S>& v)
+{
+    return uint32_t(int32_t(v.get()));
+}
+
+template <class T>
+inline std::enable_if_t<std::is_integral<T>::value, uint32_t>
+toCoefWord(T v)
+{
+    return uint32_t(v);
+}
+
+inline void
+fromCoefWord(float& v, uint32_t w)
+{
+    memcpy(&v, &w, sizeof(v));
+}
+
+template <class T, int S>
+inline void
+fromCoefWord(FixedPoint<T, S>& v, uint32_t w)
+{
+    v.set(T(int32_t(w)));
+}
+
+template <class T>
+inline std::enable_if_t<std::is_integral<T>::value>
+fromCoefWord(T& v, uint32_t w)
+{
+    v = T(w);
+}
+
+} // namespace detail
+
+class CoefWriter
+{
+    std::vector<uint8_t>& bytes_;
+
+public:
+    static constexpr bool LOADING = false;
+
+    explicit CoefWriter(std::vector<uint8_t>& bytes)
+        : bytes_(bytes)
+    {
+    }
+
+    void put(uint32_t w)
+    {
+        uint32_t u = (w << 1) ^ uint32_t(int32_t(w) >> 31);
+        while (u >= 0x80)
+        {
+            bytes_.push_back(uint8_t(u | 0x80));
+            u >>= 7;
+        }
+        bytes_.push_back(uint8_t(u));
+    }
+
+    template <class T>
+    void operator()(const T& v)
+    {
+        put(detail::toCoefWord(v));
+    }
+
+    template <class T, size_t N>
+    void operator()(const std::array<T, N>& a)
+    {
+        for (auto& v : a)
+        {
+            (*this)(v);
+        }
+    }
+};
+
+// 足りなくなったら 0 を返して isValid が false になる
+class CoefReader
+{
+    const uint8_t* p_;
+    const uint8_t* end_;
+
+public:
+    static constexpr bool LOADING = true;
+
+    CoefReader(const void* p, size_t size)
+        : p_(static_cast<const uint8_t*>(p))
+        , end_(p_ + size)
+    {
+    }
+
+    uint32_t get()
+    {
+        uint32_t u = 0;
+        for (int shift = 0; p_; shift += 7)
+        {
+            if (p_ == end_ || shift > 28)
+            {
+                p_ = nullptr;
+                return 0;
+            }
+            uint8_t b = *p_++;
+            u |= uint32_t(b & 0x7f) << shift;
+            if (!(b & 0x80))
+            {
+                break;
+            }
+        }
+        return (u >> 1) ^ (0 - (u & 1));
+    }
+
+    template <class T>
+    void operator()(T& v)
+    {
+        detail::fromCoefWord(v, get());
+    }
+
+    template <class T, size_t N>
+    void operator()(std::array<T, N>& a)
+    {
+        for (auto& v : a)
+        {
+            (*this)(v);
+        }
+    }
+
+    bool isValid() const { return p_ != nullptr; }
+    const void* getPointer() const { return p_; }
+};
+
+} // namespace physical_modeling_piano
+
+#endif /* _3381141F_92B1_4432_9F28_7ABB16FD4B54 */
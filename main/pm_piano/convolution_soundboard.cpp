@@ -0,0 +1,183 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 1:48:22
+ */
+
+#include "convolution_soundboard.h"
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+namespace physical_modeling_piano
+{
+
+void
+ConvolutionSoundboard::initialize(const SystemParameters& sysParams,
+                                  size_t partitionSize)
+{
+    partitionSize_ = partitionSize;
+    fft_.initialize(partitionSize * 2);
+
+    window_.assign(partitionSize * 2, 0);
+    output_.assign(partitionSize * 2, 0);
+    partitionOut_.assign(partitionSize, 0);
+    accRe_.assign(partitionSize + 1, 0);
+    accIm_.assign(partitionSize + 1, 0);
+
+    synthesizeImpulseResponse(sysParams, DEFAULT_IR_SECONDS);
+}
+
+void
+ConvolutionSoundboard::setImpulseResponse(const float* h, size_t n)
+{
+    const size_t B    = partitionSize_;
+    const size_t bins = B + 1;
+
+    irLength_    = n;
+    nPartitions_ = (n + B - 1) / B;
+    filterRe_.assign(nPartitions_ * bins, 0);
+    filterIm_.assign(nPartitions_ * bins, 0);
+    inputRe_.assign(nPartitions_ * bins, 0);
+    inputIm_.assign(nPartitions_ * bins, 0);
+    inputHead_ = 0;
+
+    // 各パーティションを後ろを 0 で埋めた 2B 点にして変換しておく
+    std::vector<float> tmp(B * 2);
+    float sumAbs = 0;
+    for (size_t p = 0; p < nPartitions_; ++p)
+    {
+        std::fill(tmp.begin(), tmp.end(), 0);
+        auto top = p * B;
+        auto len = std::min(B, n - top);
+        std::copy(h + top, h + top + len, tmp.begin());
+        fft_.forward(&filterRe_[p * bins], &filterIm_[p * bins], tmp.data());
+
+        for (size_t i = 0; i < len; ++i)
+        {
+            sumAbs += fabsf(h[top + i]);
+        }
+    }
+
+    // 出力の 1LSB は ResultT の 1/32768
+    silentInput_ = 0.5f / 32768 / std::max(sumAbs, 1e-6f);
+
+    std::fill(window_.begin(), window_.end(), 0);
+    quietSamples_ = irLength_;
+}
+
+void
+ConvolutionSoundboard::synthesizeImpulseResponse(
+    const SystemParameters& sysParams, float seconds)
+{
+    // 固定小数点の FDN が溢れない大きさのインパルスを入れて割り戻す
+    // 切り捨ての偏りが長い応答の直流で積もるので、正負の応答の差をとって消す
+    constexpr float IMPULSE = 0.25f;
+
+    // 遅延線も含めて応答を作る間だけ使う
+    Soundboard fdn;
+    const size_t n = size_t(seconds * sysParams.sampleRate);
+    std::vector<ValueT> src(n, 0.0f);
+    std::vector<ResultT> dst(n);
+    std::vector<float> h(n, 0.0f);
+    for (float sign : {1.0f, -1.0f})
+    {
+        fdn.initialize(sysParams);
+        src[0] = IMPULSE * sign;
+        fdn.update(dst.data(), src.data(), n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            h[i] += float(dst[i]) * (sign * 0.5f / IMPULSE);
+        }
+    }
+    setImpulseResponse(h.data(), n);
+}
+
+void
+ConvolutionSoundboard::update(ResultT* dst,
+                              const ValueT* src,
+                              size_t nSamples)
+{
+    assert(nSamples % partitionSize_ == 0);
+    for (size_t i = 0; i < nSamples; i += partitionSize_)
+    {
+        processPartition(dst + i, src + i);
+    }
+}
+
+void
+ConvolutionSoundboard::update(OutputSink& sink,
+                              const ValueT* src,
+                              size_t nSamples)
+{
+    static_assert(sizeof(ResultT) == sizeof(int32_t), "");
+
+    assert(nSamples % partitionSize_ == 0);
+    auto* out = partitionOut_.data();
+    for (size_t i = 0; i < nSamples; i += partitionSize_)
+    {
+        processPartition(out, src + i);
+        sink.write(reinterpret_cast<const int32_t*>(out), partitionSize_);
+    }
+}
+
+void
+ConvolutionSoundboard::processPartition(ResultT* dst, const ValueT* src)
+{
+    const size_t B    = partitionSize_;
+    const size_t bins = B + 1;
+
+    float peak = 0;
+    for (size_t i = 0; i < B; ++i)
+    {
+        float v         = src[i];
+        window_[B + i]  = v;
+        peak            = std::max(peak, fabsf(v));
+    }
+    quietSamples_ = peak <= silentInput_ ? quietSamples_ + B : 0;
+
+    inputHead_ = inputHead_ ? inputHead_ - 1 : nPartitions_ - 1;
+    float* xr  = &inputRe_[inputHead_ * bins];
+    float* xi  = &inputIm_[inputHead_ * bins];
+    fft_.forward(xr, xi, window_.data());
+
+    // Y = Σ X[今 - p] H[p]、遅延線は inputHead_ から新しい順
+    std::fill(accRe_.begin(), accRe_.end(), 0);
+    std::fill(accIm_.begin(), accIm_.end(), 0);
+    float* __restrict yr = accRe_.data();
+    float* __restrict yi = accIm_.data();
+    size_t slot          = inputHead_;
+    for (size_t p = 0; p < nPartitions_; ++p)
+    {
+        const float* __restrict ar = &inputRe_[slot * bins];
+        const float* __restrict ai = &inputIm_[slot * bins];
+        const float* __restrict hr = &filterRe_[p * bins];
+        const float* __restrict hi = &filterIm_[p * bins];
+        for (size_t k = 0; k < bins; ++k)
+        {
+            yr[k] += ar[k] * hr[k] - ai[k] * hi[k];
+            yi[k] += ar[k] * hi[k] + ai[k] * hr[k];
+        }
+        slot = slot + 1 < nPartitions_ ? slot + 1 : 0;
+    }
+
+    // 循環畳み込みの後半 B 点が線形畳み込みと一致する
+    fft_.inverse(output_.data(), yr, yi);
+    for (size_t i = 0; i < B; ++i)
+    {
+        dst[i] = output_[B + i];
+    }
+
+    std::copy(window_.begin() + B, window_.end(), window_.begin());
+}
+
+void
+ConvolutionSoundboard::clear()
+{
+    std::fill(inputRe_.begin(), inputRe_.end(), 0);
+    std::fill(inputIm_.begin(), inputIm_.end(), 0);
+    std::fill(window_.begin(), window_.end(), 0);
+    quietSamples_ = irLength_;
+}
+
+} // namespace physical_modeling_piano
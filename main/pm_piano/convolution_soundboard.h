@@ -0,0 +1,73 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 1:30:5
+ */
+#ifndef _0D8E47B3_6134_1E50_2A6C_F41B9C07D5E8
+#define _0D8E47B3_6134_1E50_2A6C_F41B9C07D5E8
+
+#include "real_fft.h"
+#include "soundboard.h"
+#include <vector>
+
+namespace physical_modeling_piano
+{
+
+// インパルス応答の畳み込みによる響板 (host 用、浮動小数点)
+// 長さ B のパーティションに等分し、周波数領域の遅延線で重畳加算 (overlap-save)
+// update の nSamples は B の倍数にすれば遅延は無い
+class ConvolutionSoundboard : public SoundboardTypes
+{
+public:
+    // pm_bench の convolution で 64-256 サンプルのブロックに対して選んだもの
+    static constexpr size_t DEFAULT_PARTITION_SIZE = 128;
+    static constexpr float DEFAULT_IR_SECONDS      = 1.0f;
+
+private:
+    size_t partitionSize_{}; // B
+    size_t nPartitions_{};
+    size_t irLength_{};
+    RealFFT fft_; // 2B 点
+
+    // スペクトルは B+1 点ずつ [パーティション][ビン]
+    std::vector<float> filterRe_;
+    std::vector<float> filterIm_;
+    std::vector<float> inputRe_; // 入力の周波数領域の遅延線 (リング)
+    std::vector<float> inputIm_;
+    size_t inputHead_{}; // 最新のスペクトルの位置
+
+    std::vector<float> window_; // 直前のブロックと今回のブロック 2B
+    std::vector<float> accRe_;
+    std::vector<float> accIm_;
+    std::vector<float> output_;         // 2B
+    std::vector<ResultT> partitionOut_; // sink に渡す B
+
+    float silentInput_{}; // 入力の絶対値がこれ以下なら出力は 1/2 LSB 未満
+    size_t quietSamples_{};
+
+public:
+    void initialize(const SystemParameters& sysParams,
+                    size_t partitionSize = DEFAULT_PARTITION_SIZE);
+    // h: ValueT の単位インパルスに対する ResultT の値、実測したものなど
+    void setImpulseResponse(const float* h, size_t n);
+    // FDN の Soundboard のインパルス応答を seconds 秒分使う
+    void synthesizeImpulseResponse(const SystemParameters& sysParams,
+                                   float seconds);
+
+    void update(ResultT* dst, const ValueT* src, size_t nSamples);
+    // パーティションごとの出力をそのまま sink に渡す
+    void update(OutputSink& sink, const ValueT* src, size_t nSamples);
+
+    bool isSilent() const { return quietSamples_ >= irLength_; }
+    void clear();
+
+    size_t getPartitionSize() const { return partitionSize_; }
+    size_t getPartitionCount() const { return nPartitions_; }
+    size_t getImpulseResponseLength() const { return irLength_; }
+
+protected:
+    void processPartition(ResultT* dst, const ValueT* src);
+};
+
+} // namespace physical_modeling_piano
+
+#endif /* _0D8E47B3_6134_1E50_2A6C_F41B9C07D5E8 */
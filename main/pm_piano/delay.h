@@ -9,6 +9,7 @@
 #include <algorithm>
 #include <array>
 #include <assert.h>
+#include <limits>
 #include <stdlib.h>
 #include <string.h>
 
@@ -23,6 +24,8 @@ class DelayState
     T* buffer_{};
 
 public:
+    using StorageT = T;
+
     DelayState() = default;
     DelayState(T* buffer, size_t size) { attachBuffer(buffer, size); }
 
@@ -55,15 +58,162 @@ public:
         }
     }
 
-    void clear(size_t delay)
+    // update を n 回呼ぶのを読み出しと書き込みに分けたもの
+    // n <= delay なら読む値は全てこれから書く分より前のもの
+    void read(T* dst, size_t n, size_t delay) const
+    {
+        assert(n <= delay);
+        auto p  = (cursor_ - delay) & mask_;
+        auto n0 = std::min(n, mask_ + 1 - p);
+        std::copy(buffer_ + p, buffer_ + p + n0, dst);
+        std::copy(buffer_, buffer_ + n - n0, dst + n0);
+    }
+
+    void write(const T* src, size_t n)
+    {
+        auto n0 = std::min(n, mask_ + 1 - cursor_);
+        std::copy(src, src + n0, buffer_ + cursor_);
+        std::copy(src + n0, src + n, buffer_);
+        cursor_ = (cursor_ + n) & mask_;
+    }
+
+    // zeroFill が false ならバッファは既に 0 になっているものとする
+    void clear(size_t delay, bool zeroFill = true)
     {
         //        printf("delay = %zd/%zd\n", delay, mask_);
         assert(delay <= mask_);
-        memset(buffer_, 0, sizeof(T) * (delay + 1));
+        if (zeroFill)
+        {
+            std::fill(buffer_, buffer_ + delay + 1, T(0));
+        }
         cursor_ = delay;
     }
 };
 
+// 遅延長ちょうどのバッファで回すもの
+// 読んだ場所にそのまま書くので、バッファ長 = 遅延長
+template <class T = float>
+class ExactDelayState
+{
+    size_t size_   = 0;
+    size_t cursor_ = 0;
+    T* buffer_{};
+
+public:
+    using StorageT = T;
+
+    ExactDelayState() = default;
+    ExactDelayState(T* buffer, size_t size) { attachBuffer(buffer, size); }
+
+    void attachBuffer(T* buffer, size_t size)
+    {
+        buffer_ = buffer;
+        size_   = size;
+    }
+
+    inline T update(const T& in, size_t delay)
+    {
+        if (delay)
+        {
+            auto r           = buffer_[cursor_];
+            buffer_[cursor_] = in;
+
+            // 分岐ではなく条件付き代入になるように
+            auto next = cursor_ + 1;
+            cursor_   = next == size_ ? 0 : next;
+            return r;
+        }
+        else
+        {
+            return in;
+        }
+    }
+
+    void clear(size_t delay, bool zeroFill = true)
+    {
+        assert(delay == size_);
+        if (zeroFill)
+        {
+            std::fill(buffer_, buffer_ + delay, T(0));
+        }
+        cursor_ = 0;
+    }
+};
+
+// ExactDelayState と同じ並びで、中身を 2^shift で割った int16 で持つもの
+// T は 32bit の FixedPoint
+template <class T, class S = int16_t>
+class CompressedDelayState
+{
+    size_t size_   = 0;
+    size_t cursor_ = 0;
+    S* buffer_{};
+    int shift_{};
+    int32_t round_{};
+    int32_t error_{};
+
+public:
+    using StorageT = S;
+
+    CompressedDelayState() = default;
+    CompressedDelayState(S* buffer, size_t size) { attachBuffer(buffer, size); }
+
+    void attachBuffer(S* buffer, size_t size)
+    {
+        buffer_ = buffer;
+        size_   = size;
+    }
+
+    void setShift(int shift)
+    {
+        shift_ = shift;
+        round_ = (1 << shift) >> 1;
+    }
+    int getShift() const { return shift_; }
+
+    inline T update(const T& in, size_t delay)
+    {
+        if (delay)
+        {
+            T r;
+            r.set(static_cast<int32_t>(buffer_[cursor_]) << shift_);
+            buffer_[cursor_] = compress(in);
+
+            auto next = cursor_ + 1;
+            cursor_   = next == size_ ? 0 : next;
+            return r;
+        }
+        else
+        {
+            return in;
+        }
+    }
+
+    void clear(size_t delay, bool zeroFill = true)
+    {
+        assert(delay == size_);
+        if (zeroFill)
+        {
+            memset(buffer_, 0, sizeof(S) * delay);
+        }
+        cursor_ = 0;
+        error_  = 0;
+    }
+
+protected:
+    // 丸め誤差を次のサンプルに繰り越して (1次のノイズシェーピング)
+    // 弦のループで直流付近の誤差が積もらないようにする
+    S compress(const T& v)
+    {
+        int32_t x = v.get() + error_;
+        int32_t q = (x + round_) >> shift_;
+        q         = std::min<int32_t>(q, std::numeric_limits<S>::max());
+        q         = std::max<int32_t>(q, std::numeric_limits<S>::min());
+        error_    = x - (q << shift_);
+        return static_cast<S>(q);
+    }
+};
+
 template <size_t Size>
 class Delay
 {
@@ -93,6 +243,12 @@ computeDelayBufferSize(size_t delay)
     return 1 << (32 - lz);
 }
 
+inline size_t
+computeExactDelayBufferSize(size_t delay)
+{
+    return delay;
+}
+
 } // namespace physical_modeling_piano
 
 #endif /* EB296768_9134_14C0_1065_A859B7225127 */
@@ -4,6 +4,7 @@
  */
 
 #include "filter.h"
+#include <algorithm>
 #include <math.h>
 #include <stdio.h>
 
@@ -242,6 +243,29 @@ thirian(int cn, float* ca, float* cb, float D)
     }
 }
 
+void
+thirian1(float* ca, float* cb, float D, float f, float Fs)
+{
+    auto design = [&](float d) {
+        float a1 = (1 - d) / (1 + d);
+        ca[0]    = 1;
+        ca[1]    = a1;
+        cb[0]    = a1;
+        cb[1]    = 1;
+    };
+
+    // thirian(1, D) は低域での遅延が D になる。
+    // f での位相遅延が D になるまで設計値をずらす
+    constexpr float minD = 0.1f; // 0 に近いと z=-1 に極が寄る
+    float Dd             = std::max(minD, D);
+    for (int i = 0; i < 4; ++i)
+    {
+        design(Dd);
+        Dd = std::max(minD, Dd + D - computePhaseDelay(1, ca, cb, f, Fs));
+    }
+    design(Dd);
+}
+
 void
 makeThirianDispersionFilter(float* ca, float* cb, float B, float f, int M)
 {
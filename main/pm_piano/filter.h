@@ -9,6 +9,8 @@
 #include <array>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <type_traits>
 #include <utility>
 
 namespace physical_modeling_piano
@@ -31,6 +33,7 @@ float
 computeGroupDelay(int cn, const float* ca, const float* cb, float f, float Fs);
 
 void thirian(int cn, float* ca, float* cb, float D);
+void thirian1(float* ca, float* cb, float D, float f, float Fs);
 
 void dumpFilter(const char* str, int n, const float* a, const float* b);
 
@@ -102,7 +105,7 @@ public:
 
     float computeGroupDelay(int N, float f, float Fs) const
     {
-        assert(N + 1 <= Size);
+        assert(N + 1 <= int(Size));
         float ca[Size];
         float cb[Size];
         for (int i = 0; i < N + 1; ++i)
@@ -113,6 +116,19 @@ public:
         return detail::computeGroupDelay(N, ca, cb, f, Fs);
     }
 
+    float computePhaseDelay(int N, float f, float Fs) const
+    {
+        assert(N + 1 <= int(Size));
+        float ca[Size];
+        float cb[Size];
+        for (int i = 0; i < N + 1; ++i)
+        {
+            ca[i] = a[i];
+            cb[i] = b[i];
+        }
+        return detail::computePhaseDelay(N, ca, cb, f, Fs);
+    }
+
     void reset()
     {
         a[0] = 1.0f;
@@ -171,6 +187,11 @@ public:
         return constant_.computeGroupDelay(N, f, Fs);
     }
 
+    float computePhaseDelay(float f, float Fs) const
+    {
+        return constant_.computePhaseDelay(N, f, Fs);
+    }
+
     void reset() { constant_.reset(); }
 
     void copy(const float* sa, const float* sb)
@@ -210,11 +231,25 @@ public:
         return (constant_.*filterFunc_)(in, st);
     }
 
+    // 次数が静的に決まっている場合
+    template <size_t N>
+    TV filter(const TV& in, State& st) const
+    {
+        return constant_.template filter<N, N_MAX, TV, TH>(in, st);
+    }
+
+    size_t getDim() const { return n_; }
+
     float computeGroupDelay(float f, float Fs) const
     {
         return constant_.computeGroupDelay(n_, f, Fs);
     }
 
+    float computePhaseDelay(float f, float Fs) const
+    {
+        return constant_.computePhaseDelay(n_, f, Fs);
+    }
+
     void reset() { constant_.reset(); }
 
     void clear(State& st) const { st.clear(n_); }
@@ -224,6 +259,19 @@ public:
         constant_.copy(sa, sb, size);
     }
 
+    // filterFunc_ は保存せず次数から選び直す
+    template <class Archive>
+    void serializeCoefficients(Archive& ar)
+    {
+        ar(constant_.a);
+        ar(constant_.b);
+        ar(n_);
+        if (Archive::LOADING)
+        {
+            setDim(n_);
+        }
+    }
+
 protected:
     Constant& getConstant() { return constant_; }
 
@@ -308,14 +356,39 @@ public:
     {
         float ca[2];
         float cb[2];
+        getCoefficients(ca, cb);
+        return detail::computeGroupDelay(1, ca, cb, f, Fs);
+    }
+
+    float computePhaseDelay(float f, float Fs) const
+    {
+        float ca[2];
+        float cb[2];
+        getCoefficients(ca, cb);
+        return detail::computePhaseDelay(1, ca, cb, f, Fs);
+    }
+
+    void clear(State& st) const { st.h0 = 0; }
+
+    // out = h0 + b0 * in, h0 = ma1 * out
+    const TC& getB0() const { return b0_; }
+    const TC& getMA1() const { return ma1_; }
+
+    template <class Archive>
+    void serializeCoefficients(Archive& ar)
+    {
+        ar(ma1_);
+        ar(b0_);
+    }
+
+protected:
+    void getCoefficients(float ca[2], float cb[2]) const
+    {
         ca[0] = 1.0f;
         ca[1] = -ma1_;
         cb[0] = b0_;
         cb[1] = 0;
-        return detail::computeGroupDelay(1, ca, cb, f, Fs);
     }
-
-    void clear(State& st) const { st.h0 = 0; }
 };
 #endif
 
@@ -333,6 +406,160 @@ public:
     }
 };
 
+////
+// 同じ係数の ThirianDispersionFilter を N 段つないだもの
+// 2次 allpass なので b = {a2, a1, 1} を利用して乗算を減らし、
+// 段数をコンパイル時に展開して 1 回の呼び出しで処理する
+template <size_t N_MAX, class TC = float, class TH = float>
+class ThirianDispersionCascade
+{
+    TC a1_{};
+    TC a2_{};
+    int n_{};
+    bool identity_{};
+
+public:
+    using State = IIRFilterState<N_MAX * 2, TH>;
+
+public:
+    void initialize(float B, float f, int n)
+    {
+        assert(n >= 1);
+        assert(n <= int(N_MAX));
+
+        float ca[3];
+        float cb[3];
+        detail::makeThirianDispersionFilter(ca, cb, B, f, n);
+
+        if (cb[2] != 1.0f)
+        {
+            initializeIdentity(n);
+        }
+        else
+        {
+            assert(ca[0] == 1.0f && cb[0] == ca[2] && cb[1] == ca[1]);
+            n_        = n;
+            identity_ = false;
+            a1_       = ca[1];
+            a2_       = ca[2];
+        }
+    }
+
+    // n 段のまま素通しにする
+    void initializeIdentity(int n)
+    {
+        assert(n >= 1);
+        assert(n <= int(N_MAX));
+
+        // a1 = 0, a2 = 1 は状態が 0 から始まる限り厳密に素通しになる
+        n_        = n;
+        identity_ = true;
+        a1_       = 0.0f;
+        a2_       = 1.0f;
+    }
+
+    template <int N, class TV>
+    TV filter(const TV& in, State& st) const
+    {
+        static_assert(N >= 1 && N <= N_MAX, "");
+        return stages(in, st.state.data(), std::integral_constant<int, N>());
+    }
+
+    template <class TV>
+    TV filter(const TV& in, State& st) const
+    {
+        TV y = in;
+        for (int i = 0; i < n_; ++i)
+        {
+            y = stage(y, st.state[i * 2], st.state[i * 2 + 1]);
+        }
+        return y;
+    }
+
+    float computeGroupDelay(float f, float Fs) const
+    {
+        if (identity_)
+        {
+            return 0;
+        }
+        float ca[3];
+        float cb[3];
+        getCoefficients(ca, cb);
+        return n_ * detail::computeGroupDelay(2, ca, cb, f, Fs);
+    }
+
+    float computePhaseDelay(float f, float Fs) const
+    {
+        if (identity_)
+        {
+            return 0;
+        }
+        float ca[3];
+        float cb[3];
+        getCoefficients(ca, cb);
+        return n_ * detail::computePhaseDelay(2, ca, cb, f, Fs);
+    }
+
+    void clear(State& st) const { st.clear(); }
+
+    int getStages() const { return n_; }
+
+    template <class Archive>
+    void serializeCoefficients(Archive& ar)
+    {
+        ar(a1_);
+        ar(a2_);
+        ar(n_);
+        ar(identity_);
+    }
+
+protected:
+    template <class TV, int I>
+    TV stages(const TV& in,
+              TH* __restrict__ h,
+              std::integral_constant<int, I>) const
+    {
+        TV y = stages(in, h, std::integral_constant<int, I - 1>());
+        return stage(y, h[I * 2 - 2], h[I * 2 - 1]);
+    }
+
+    template <class TV>
+    TV stages(const TV& in,
+              TH* __restrict__,
+              std::integral_constant<int, 0>) const
+    {
+        return in;
+    }
+
+    template <class TV>
+    TV stage(const TV& in, TH& h0, TH& h1) const
+    {
+        // out = h0 + a2 * in
+        // h0  = h1 + a1 * in - a1 * out
+        // h1  = in - a2 * out
+        TV out;
+        madd(out, h0, a2_, in);
+
+        TH tmp;
+        madd(tmp, h1, a1_, in);
+        nmsub(h0, tmp, a1_, out);
+
+        shift<0>(tmp, in);
+        nmsub(h1, tmp, a2_, out);
+        return out;
+    }
+
+    void getCoefficients(float ca[3], float cb[3]) const
+    {
+        ca[0] = 1.0f;
+        ca[1] = a1_;
+        ca[2] = a2_;
+        cb[0] = a2_;
+        cb[1] = a1_;
+        cb[2] = 1.0f;
+    }
+};
+
 ////
 template <size_t N_MAX, class TC = float, class TH = float, class TV = float>
 class ThirianFilter : public VariableSizeIIRFilter<N_MAX, TC, TH, TV>
@@ -345,9 +572,23 @@ public:
         float ca[N_MAX + 1];
         float cb[N_MAX + 1];
         detail::thirian(N, ca, cb, D);
+        this->reset(); // N 以降の係数は 0 にしておく
         this->copy(ca, cb, N + 1);
         detail::dumpFilter("thirian", N, ca, cb);
     }
+
+    // f での位相遅延が D になる 1次 allpass
+    void initializeFirstOrder(float D, float f, float Fs)
+    {
+        this->setDim(1);
+
+        float ca[2];
+        float cb[2];
+        detail::thirian1(ca, cb, D, f, Fs);
+        this->reset();
+        this->copy(ca, cb, 2);
+        detail::dumpFilter("thirian1", 1, ca, cb);
+    }
 };
 
 ////
@@ -5,12 +5,21 @@
 #ifndef _4CAD8B76_C134_14C4_1746_4D5010DEF3DD
 #define _4CAD8B76_C134_14C4_1746_4D5010DEF3DD
 
+#include <algorithm>
+#include <limits>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <type_traits>
 #include <utility>
 
+// 1 にすると FixedPoint の型ごとの値域と丸め誤差を記録する (tools/qformat_tune)
+#ifndef PM_PIANO_FIXED_PROFILE
+#define PM_PIANO_FIXED_PROFILE 0
+#endif
+
 namespace physical_modeling_piano
 {
 
@@ -49,6 +58,236 @@ dshift(T v, int s)
 {
     return s >= 0 ? v << s : v >> -s;
 }
+
+#if PM_PIANO_FIXED_PROFILE
+struct FixedPointProfile
+{
+    int bits;
+    bool isSigned;
+    int shift;
+
+    uint64_t count;
+    uint64_t overflow;
+    int64_t maxAbs; // raw値
+
+    uint64_t productCount; // この型を被演算子とする積
+    uint64_t productOverflow;
+
+    uint64_t roundCount;
+    double maxRoundError; // 実数値
+    double sumRoundError2;
+
+    FixedPointProfile* next;
+};
+
+inline FixedPointProfile*&
+getFixedPointProfileList()
+{
+    static FixedPointProfile* top{};
+    return top;
+}
+
+// 被演算子の型の組ごとの積
+struct ProductProfile
+{
+    const FixedPointProfile* a;
+    const FixedPointProfile* b;
+    int bits; // 積の型
+
+    uint64_t count;
+    uint64_t overflow;
+    int headroom; // 最小余裕bit数
+
+    ProductProfile* next;
+};
+
+inline ProductProfile*&
+getProductProfileList()
+{
+    static ProductProfile* top{};
+    return top;
+}
+
+template <class T, int S>
+FixedPointProfile&
+getFixedPointProfile()
+{
+    static FixedPointProfile p = [] {
+        FixedPointProfile r{};
+        r.bits            = sizeof(T) * 8;
+        r.isSigned        = std::is_signed<T>::value;
+        r.shift           = S;
+        return r;
+    }();
+    static bool registered = [] {
+        p.next                     = getFixedPointProfileList();
+        getFixedPointProfileList() = &p;
+        return true;
+    }();
+    (void)registered;
+    return p;
+}
+
+inline int
+getBitLength(int64_t v)
+{
+    uint64_t a = v < 0 ? -v : v;
+    return a ? 64 - __builtin_clzll(a) : 0;
+}
+
+template <class T>
+bool
+isInRange(int64_t v)
+{
+    return v >= (int64_t)std::numeric_limits<T>::min() &&
+           v <= (int64_t)std::numeric_limits<T>::max();
+}
+
+template <class T, int S>
+void
+profileValue(int64_t v)
+{
+    auto& p = getFixedPointProfile<T, S>();
+    ++p.count;
+    if (!isInRange<T>(v))
+    {
+        ++p.overflow;
+    }
+    auto a   = v < 0 ? -v : v;
+    p.maxAbs = a > p.maxAbs ? a : p.maxAbs;
+}
+
+template <class T, int S>
+void
+profileRound(double err)
+{
+    auto& p = getFixedPointProfile<T, S>();
+    err     = fabs(err);
+    ++p.roundCount;
+    p.sumRoundError2 += err * err;
+    p.maxRoundError = err > p.maxRoundError ? err : p.maxRoundError;
+}
+
+template <class T1, int S1, class T2, int S2, class P>
+ProductProfile&
+getProductProfile()
+{
+    static ProductProfile p = [] {
+        ProductProfile r{};
+        r.a        = &getFixedPointProfile<T1, S1>();
+        r.b        = &getFixedPointProfile<T2, S2>();
+        r.bits     = sizeof(P) * 8;
+        r.headroom = 64;
+        return r;
+    }();
+    static bool registered = [] {
+        p.next                  = getProductProfileList();
+        getProductProfileList() = &p;
+        return true;
+    }();
+    (void)registered;
+    return p;
+}
+
+template <class T1, int S1, class T2, int S2, class P>
+void
+profileProduct(int64_t v)
+{
+    auto& p = getProductProfile<T1, S1, T2, S2, P>();
+    ++p.count;
+    bool overflow = !isInRange<P>(v);
+    p.overflow += overflow;
+    p.headroom = std::min(p.headroom, (int)sizeof(P) * 8 - 1 - getBitLength(v));
+
+    for (auto* t : {&getFixedPointProfile<T1, S1>(),
+                    &getFixedPointProfile<T2, S2>()})
+    {
+        ++t->productCount;
+        t->productOverflow += overflow;
+    }
+}
+
+// src (小数部 S - LSHIFT bit) を LSHIFT bit シフトして T,S 型に格納する
+template <class T, int S, int LSHIFT>
+void
+profileShift(int64_t src)
+{
+    int64_t r = LSHIFT >= 0 ? src * ((int64_t)1 << (LSHIFT & 63))
+                            : src >> ((-LSHIFT) & 63);
+    profileValue<T, S>(r);
+    if (LSHIFT < 0)
+    {
+        int64_t lost = src - r * ((int64_t)1 << ((-LSHIFT) & 63));
+        profileRound<T, S>(ldexp((double)lost, -(S - LSHIFT)));
+    }
+}
+
+template <class T, int S>
+void
+profileAssign(float scaled, T v)
+{
+    profileValue<T, S>((int64_t)(scaled + 0.5f));
+    profileRound<T, S>(ldexp((double)scaled - v, -S));
+}
+
+// P: 積を求める型
+template <class T,
+          int SD,
+          class T1,
+          int S1,
+          class T2,
+          int S2,
+          class P = decltype(T1() * T2())>
+void
+profileMul(int64_t c, int64_t a, int64_t b)
+{
+    int64_t prod = a * b;
+    profileProduct<T1, S1, T2, S2, P>(prod);
+    profileShift<T, SD, SD - S1 - S2>(c + prod);
+}
+#else
+template <class T, int S>
+inline void
+profileValue(int64_t)
+{
+}
+
+template <class T, int S>
+inline void
+profileRound(double)
+{
+}
+
+template <class T1, int S1, class T2, int S2, class P>
+inline void
+profileProduct(int64_t)
+{
+}
+
+template <class T, int S, int LSHIFT>
+inline void
+profileShift(int64_t)
+{
+}
+
+template <class T, int S>
+inline void
+profileAssign(float, T)
+{
+}
+
+template <class T,
+          int SD,
+          class T1,
+          int S1,
+          class T2,
+          int S2,
+          class P = decltype(T1() * T2())>
+inline void
+profileMul(int64_t, int64_t, int64_t)
+{
+}
+#endif
 } // namespace detail
 
 template <class T, int LSHIFT>
@@ -79,6 +318,7 @@ public:
     template <int S2>
     self& operator=(const FixedPoint<T, S2>& v)
     {
+        detail::profileShift<T, LSHIFT, LSHIFT - S2>(v.get());
         value_ = detail::shift<LSHIFT - S2>(v.get());
         return *this;
     }
@@ -86,6 +326,7 @@ public:
     self& operator=(float v)
     {
         assign(v);
+        detail::profileAssign<T, LSHIFT>(v * scale_, value_);
         return *this;
     }
 
@@ -107,6 +348,7 @@ template <int N, class T, int S1, int S2>
 void
 shift(FixedPoint<T, S1>& dst, const FixedPoint<T, S2>& v)
 {
+    detail::profileShift<T, S1, S1 - S2 + N>(v.get());
     dst.set(detail::shift<S1 - S2 + N>(v.get()));
 }
 
@@ -133,6 +375,7 @@ template <class T, int S>
 void
 neg(FixedPoint<T, S>& dst, const FixedPoint<T, S>& v)
 {
+    detail::profileValue<T, S>(-(int64_t)v.get());
     dst.set(-v.get());
 }
 
@@ -160,6 +403,7 @@ template <class T, int S>
 void
 add(FixedPoint<T, S>& dst, const FixedPoint<T, S>& a, const FixedPoint<T, S>& b)
 {
+    detail::profileValue<T, S>((int64_t)a.get() + b.get());
     dst.set(a.get() + b.get());
 }
 
@@ -173,6 +417,7 @@ template <class T, int S>
 void
 sub(FixedPoint<T, S>& dst, const FixedPoint<T, S>& a, const FixedPoint<T, S>& b)
 {
+    detail::profileValue<T, S>((int64_t)a.get() - b.get());
     dst.set(a.get() - b.get());
 }
 
@@ -188,9 +433,27 @@ mul(FixedPoint<T, SD>& dst,
     const FixedPoint<T1, S1>& a,
     const FixedPoint<T2, S2>& b)
 {
+    detail::profileMul<T, SD, T1, S1, T2, S2>(0, a.get(), b.get());
     dst.set(detail::shift<SD - S1 - S2>(a.get() * b.get()));
 }
 
+inline void
+mulWide(float& dst, float a, float b)
+{
+    dst = a * b;
+}
+
+// 積が 32bit に収まらないときに 64bit で求める (結果は dst に収まること)
+template <int SD, class T, class T1, class T2, int S1, int S2>
+void
+mulWide(FixedPoint<T, SD>& dst,
+        const FixedPoint<T1, S1>& a,
+        const FixedPoint<T2, S2>& b)
+{
+    detail::profileMul<T, SD, T1, S1, T2, S2, int64_t>(0, a.get(), b.get());
+    dst.set(T(detail::shift<SD - S1 - S2>(int64_t(a.get()) * b.get())));
+}
+
 // template <class T1, class T2, class T3, int S>
 // void
 // mul(FixedPoint<T1, S>& dst, const FixedPoint<T2, S>& a, T3 b)
@@ -224,9 +487,30 @@ madd(FixedPoint<T, SD>& dst,
      const FixedPoint<T1, S1>& a,
      const FixedPoint<T2, S2>& b)
 {
+    detail::profileMul<T, SD, T1, S1, T2, S2>(c.get(), a.get(), b.get());
     dst.set(detail::shift<SD - S1 - S2>(c.get() + a.get() * b.get()));
 }
 
+inline void
+maddWide(float& dst, float c, float a, float b)
+{
+    dst = c + a * b;
+}
+
+// madd の積と和を 64bit で求める (c と結果は dst に収まること)
+template <int SD, class T, class T1, class T2, int S1, int S2>
+void
+maddWide(FixedPoint<T, SD>& dst,
+         const FixedPoint<T, S1 + S2>& c,
+         const FixedPoint<T1, S1>& a,
+         const FixedPoint<T2, S2>& b)
+{
+    detail::profileMul<T, SD, T1, S1, T2, S2, int64_t>(
+        c.get(), a.get(), b.get());
+    dst.set(T(detail::shift<SD - S1 - S2>(int64_t(c.get()) +
+                                          int64_t(a.get()) * b.get())));
+}
+
 // template <class T, class T1, class T2, class T3, int S>
 // void
 // madd(FixedPoint<T, S>& dst,
@@ -250,6 +534,7 @@ nmsub(FixedPoint<T, SD>& dst,
       const FixedPoint<T1, S1>& a,
       const FixedPoint<T2, S2>& b)
 {
+    detail::profileMul<T, SD, T1, S1, T2, S2>(c.get(), -a.get(), b.get());
     dst.set(detail::shift<SD - S1 - S2>(c.get() - a.get() * b.get()));
 }
 
@@ -278,6 +563,7 @@ log2estimate(FixedPoint<T, S1>& dst, const FixedPoint<T, S2>& v)
     T n = 31 - lz - S2;
 
     dst.set((n << S1) | static_cast<T>(uiv));
+    detail::profileValue<T, S1>(dst.get());
 }
 
 template <class T, int S1, int S2>
@@ -300,6 +586,7 @@ log2estimate2(FixedPoint<T, S1>& dst, const FixedPoint<T, S2>& v)
 
     T n = 31 - lz - S2;
     dst.set((n << S1) + static_cast<T>(vv));
+    detail::profileValue<T, S1>(dst.get());
 }
 
 template <class T, int S1, int S2>
@@ -318,6 +605,7 @@ exp2estimate(FixedPoint<T, S1>& dst, const FixedPoint<T, S2>& v)
     T e2a = a + detail::shift<S2>(1);
 
     dst.set(detail::dshift(e2a, n + (S1 - S2)));
+    detail::profileValue<T, S1>(dst.get());
 }
 
 template <class T, int S1, int S2>
@@ -340,6 +628,7 @@ exp2estimate2(FixedPoint<T, S1>& dst, const FixedPoint<T, S2>& v)
     uint32_t e2a = a1 + a2 + detail::shift<31>(1u); // .31 fixed
     int rshift   = 31 - S1 - n;
     dst.set(rshift >= 32 ? 0 : static_cast<T>(e2a >> rshift));
+    detail::profileValue<T, S1>(dst.get());
 }
 
 template <class T, int S1, int S2, int S3>
@@ -369,11 +658,13 @@ exp2estimate2(float& dst, float v)
     dst = exp2(v);
 }
 
+// 符号を除いたビット列 (0 以上の float では大小が絶対値と同じ)
 inline uint32_t
 getAbsMask(float v)
 {
-    return 0;
-    //    return *(uint32_t*)(&v) & 0x7fffffff;
+    uint32_t r;
+    memcpy(&r, &v, sizeof(r));
+    return r & 0x7fffffff;
 }
 
 template <class T, int S>
@@ -384,6 +675,21 @@ getAbsMask(const FixedPoint<T, S>& v)
     return r < 0 ? -r : r;
 }
 
+// 無音の判定用に |v| を mask に集める (mask <= getAbsMask(閾値) で判定する)
+// FixedPoint は OR (最大値以上になる)、float は OR では大小が崩れるので max
+inline void
+addAbsMask(uint32_t& mask, float v)
+{
+    mask = std::max(mask, getAbsMask(v));
+}
+
+template <class T, int S>
+void
+addAbsMask(uint32_t& mask, const FixedPoint<T, S>& v)
+{
+    mask |= getAbsMask(v);
+}
+
 } // namespace physical_modeling_piano
 
 #endif /* _4CAD8B76_C134_14C4_1746_4D5010DEF3DD */
@@ -45,15 +45,14 @@ Hammer::update(State& s,
     add(s.u, s.u, du);
 
     // upK_2Z = u > 0 ? pow(u, p) * (K/2Z) : 0
-    LogSpaceT tl;
-    log2estimate2(tl, s.u);
-    madd(tl, c1_, tl, p_);
-
-    FeltCompPT upK_2Z;
-    exp2estimate2(upK_2Z, tl);
-    if (!isPlus(s.u))
+    // u <= 0 の log2 は意味がなく p 倍で溢れるので計算しない
+    FeltCompPT upK_2Z = 0;
+    if (isPlus(s.u))
     {
-        upK_2Z = 0;
+        LogSpaceT tl;
+        log2estimate2(tl, s.u);
+        madd(tl, c1_, tl, p_);
+        exp2estimate2(upK_2Z, tl);
     }
 
     //        printf("upK_2Z: %g F_2Z: %g\n", (float)upK_2Z, (float)s.F_2Z);
@@ -108,14 +107,13 @@ Hammer::computeVelocity(VelocityT& dstV,
     add(dstU, u, du);
 
     // upK_2Z = u > 0 ? pow(u, p) * (K/2Z) : 0
-    LogSpaceT tl;
-    log2est(tl, dstU);
-    madd(tl, c1_, tl, p_);
-
-    exp2est(upK_2Z, tl);
-    if (!isPlus(dstU))
+    upK_2Z = 0;
+    if (isPlus(dstU))
     {
-        upK_2Z = 0;
+        LogSpaceT tl;
+        log2est(tl, dstU);
+        madd(tl, c1_, tl, p_);
+        exp2est(upK_2Z, tl);
     }
 
     // dupK_2Z = upK_2Z - prev_upK_2Z
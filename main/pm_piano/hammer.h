@@ -84,6 +84,17 @@ public:
                          const VelocityT& vin,
                          const SystemParameters& sysParams) const;
 
+    template <class Archive>
+    void serializeCoefficients(Archive& ar)
+    {
+        ar(p_);
+        ar(c1_);
+        ar(c2_);
+        ar(c3_);
+        ar(c2h_);
+        ar(c3h_);
+    }
+
 protected:
     inline void computeVelocity(VelocityT& dstV,
                                 FeltCompT& dstU,
@@ -7,6 +7,7 @@
 #include "allocator.h"
 #include "sys_params.h"
 #include <algorithm>
+#include <assert.h>
 #include <math.h>
 #include <stdio.h>
 
@@ -39,98 +40,228 @@ Note::initialize(float freq, const SystemParameters& sysParams)
     const float Z  = sqrtf(T * rhoL);
     const float Zb = sysParams.bridgeImpedance;
 
+    freq_ = freq;
+
     const float E     = sysParams.youngsModulus;
     const float rcore = std::min(r, 0.0006f);
     const float B =
         (PI * PI * PI) * E * (rcore * rcore * rcore * rcore) / (4 * L * L * T);
 
+    auto& k = kernel_;
+
     if (freq < 47.6f /* < G1 */)
     {
-        nStrings_ = 1;
+        k.nStrings_ = 1;
     }
     else if (freq < 84.8f /* < F2 */)
     {
-        nStrings_ = 2;
+        k.nStrings_ = 2;
     }
     else
     {
-        nStrings_ = 3;
+        k.nStrings_ = 3;
     }
 
-    _nStrings_ = 1.0f / nStrings_;
+    k._nStrings_ = 1.0f / k.nStrings_;
 
-    for (int i = 0; i < nStrings_; ++i)
+    for (int i = 0; i < k.nStrings_; ++i)
     {
-        strings_[i].initialize(freq * sysParams.tune[i],
-                               B,
-                               Z,
-                               Zb + (nStrings_ - 1) * Z,
-                               sysParams);
+        const float fi = freq * sysParams.tune[i];
+        k.strings_[i].initialize(
+            fi, B, Z, Zb + (k.nStrings_ - 1) * Z, sysParams);
+        storageHeadroomBits_[i] = String::computeStorageHeadroomBits(fi);
     }
 
     const float alpha = 0.1e-4f * keyRate;
     const float p     = 2.0f + keyRate;
     const float m     = 0.06f - 0.058f * powf(keyRate, 0.1f);
     const float K     = 40.0f * powf(0.7e-3, -p);
-    hammer_.initialize(m, K, p, Z, alpha, sysParams);
+    k.hammer_.initialize(m, K, p, Z, alpha, sysParams);
 
-    float bridgeLoadRatio = 2 * Z / (Z * nStrings_ + Zb);
-    bridgeLoadRatio_      = bridgeLoadRatio;
+    float bridgeLoadRatio = 2 * Z / (Z * k.nStrings_ + Zb);
+    k.bridgeLoadRatio_    = bridgeLoadRatio;
 
     //    printf("bridgeLoadRatio:%g %g\n", bridgeLoadRatio,
     //    (float)bridgeLoadRatio_);
 
     if (keyRate < 0.4f)
     {
-        hammerUpdateFunc_ = &Hammer::update;
+        k.hammerOrder_ = 1;
     }
     else if (keyRate < 0.85f)
     {
-        hammerUpdateFunc_ = &Hammer::update2;
+        k.hammerOrder_ = 2;
     }
     else
     {
-        hammerUpdateFunc_ = &Hammer::update4;
+        k.hammerOrder_ = 4;
+    }
+
+    // 全弦の次数を揃えて静的に展開したカーネルを選ぶ
+    int fracOrder = 1;
+    for (int i = 0; i < k.nStrings_; ++i)
+    {
+        fracOrder = std::max(fracOrder, k.strings_[i].getFracDelayOrder());
+    }
+    for (int i = 0; i < k.nStrings_; ++i)
+    {
+        k.strings_[i].setFracDelayOrder(fracOrder);
+    }
+    k.restoreRenderFunc();
+}
+
+template <int N_STRINGS, int M, int HAMMER_ORDER, int... FRAC_ORDERS>
+Note::Kernel::RenderFunc
+Note::Kernel::selectRenderFunc(int fracOrder,
+                               std::integer_sequence<int, FRAC_ORDERS...>)
+{
+    static constexpr int orders[]       = {FRAC_ORDERS...};
+    static constexpr RenderFunc table[] = {
+        &Kernel::render<N_STRINGS, FRAC_ORDERS, M, HAMMER_ORDER>...};
+    for (size_t i = 0; i < sizeof...(FRAC_ORDERS); ++i)
+    {
+        if (orders[i] == fracOrder)
+        {
+            return table[i];
+        }
+    }
+    return nullptr;
+}
+
+Note::Kernel::RenderFunc
+Note::Kernel::selectRenderFunc(int nStrings,
+                               int fracOrder,
+                               int M,
+                               int hammerOrder)
+{
+    // 周波数で決まる組み合わせと、そこに現れる端数遅延の次数のみ展開する
+    // 次数は 22.05/32/44.1/48kHz、THIRIAN/ALLPASS1 の全鍵で出るもの
+    // (ALLPASS1 は 1、THIRIAN の低音側は 5, 6、高音ほど下がる)
+#define PM_PIANO_NOTE_KERNEL(n, m, h, ...)                                     \
+    if (nStrings == n && M == m && hammerOrder == h)                           \
+    {                                                                          \
+        if (auto f = selectRenderFunc<n, m, h>(                                \
+                fracOrder, std::integer_sequence<int, __VA_ARGS__>()))         \
+        {                                                                      \
+            return f;                                                          \
+        }                                                                      \
+    }
+
+    PM_PIANO_NOTE_KERNEL(1, 4, 1, 1, 5, 6);
+    PM_PIANO_NOTE_KERNEL(2, 4, 1, 1, 5, 6);
+    PM_PIANO_NOTE_KERNEL(3, 4, 1, 1, 5, 6);
+    PM_PIANO_NOTE_KERNEL(3, 4, 2, 1, 5, 6);
+    PM_PIANO_NOTE_KERNEL(3, 1, 2, 1, 4, 5, 6);
+    PM_PIANO_NOTE_KERNEL(3, 1, 4, 1, 2, 3, 4, 5, 6);
+
+#undef PM_PIANO_NOTE_KERNEL
+
+    printf("no specialized kernel: strings %d, frac %d, M %d, hammer %d\n",
+           nStrings,
+           fracOrder,
+           M,
+           hammerOrder);
+    return &Kernel::render<0, 0, 0, 0>;
+}
+
+void
+Note::Kernel::restoreRenderFunc()
+{
+    // 端数遅延の次数は initialize で全弦揃えてある
+    int M = 1;
+    for (int i = 0; i < nStrings_; ++i)
+    {
+        M = std::max(M, strings_[i].getDispersionStages());
     }
+    renderFunc_ = selectRenderFunc(
+        nStrings_, strings_[0].getFracDelayOrder(), M, hammerOrder_);
+}
+
+float
+Note::computePitchError(int i, const SystemParameters& sysParams) const
+{
+    assert(i < kernel_.nStrings_);
+    const float Fs     = sysParams.sampleRate;
+    const float target = freq_ * sysParams.tune[i];
+
+    // ループ遅延は周波数に依存するので数回反復して収束させる
+    const auto& s = kernel_.strings_[i];
+    float f       = target;
+    for (int j = 0; j < 4; ++j)
+    {
+        f = Fs / s.computeLoopDelay(f, Fs);
+    }
+    return 1200 * log2f(f / target);
 }
 
 size_t
 Note::computeAllocatorSize() const
 {
     size_t s = 0;
-    for (int i = 0; i < nStrings_; ++i)
+    for (int i = 0; i < kernel_.nStrings_; ++i)
     {
-        s += strings_[i].getStateSize();
+        s += kernel_.strings_[i].getStateSize();
     }
     //    printf("size = %zd %zd\n", sizeof(State), s);
     return s;
 }
 
+int
+Note::computeDelayStorageShift(int i, float v) const
+{
+    return String::computeDelayStorageShift(v, storageHeadroomBits_[i]);
+}
+
 void
-Note::State::initialize(size_t allocatorSize)
+Note::State::attachBuffer(void* p, size_t size, bool cleared)
 {
-    allocatorBuffer_.resize((allocatorSize + sizeof(uint32_t) - 1) /
-                            sizeof(uint32_t));
+    buffer_        = p;
+    bufferSize_    = size;
+    bufferCleared_ = cleared;
 }
 
 void
 Note::keyOn(State& state, float v) const
 {
     //    printf("keyon %f\n", v);
-    SimpleLinearAllocator allocator(state.allocatorBuffer_.data(),
-                                    state.allocatorBuffer_.size() *
-                                        sizeof(uint32_t));
+    assert(state.buffer_);
+    assert(state.bufferSize_ >= computeAllocatorSize());
+    SimpleLinearAllocator allocator(state.buffer_, state.bufferSize_);
 
-    for (int i = 0; i < nStrings_; ++i)
+    // 前もって 0 にしてあるメモリなら遅延線のクリアは要らない
+    bool zeroFill = !state.bufferCleared_;
+    for (int i = 0; i < kernel_.nStrings_; ++i)
     {
-        strings_[i].reset(state.strings[i], allocator);
+        kernel_.strings_[i].reset(state.strings[i],
+                                  allocator,
+                                  computeDelayStorageShift(i, v),
+                                  zeroFill);
     }
+    state.bufferCleared_ = false;
     state.hammer.reset(v);
     state.keyOn     = true;
     state.sostenuto = false;
     state.idle      = false;
 }
 
+void
+Note::restrike(State& state, float v) const
+{
+    for (int i = 0; i < kernel_.nStrings_; ++i)
+    {
+        if (!kernel_.strings_[i].canRestrike(state.strings[i],
+                                             computeDelayStorageShift(i, v)))
+        {
+            keyOn(state, v);
+            return;
+        }
+    }
+
+    state.hammer.reset(v);
+    state.keyOn = true;
+    state.idle  = false;
+}
+
 void
 Note::keyOff(State& state) const
 {
@@ -138,11 +269,11 @@ Note::keyOff(State& state) const
 }
 
 void
-Note::update(SampleT* sample,
-             uint32_t nSamples,
-             State& state,
-             const SystemParameters& sysParams,
-             const PedalState& pedal) const
+Note::Kernel::update(SampleT* sample,
+                     uint32_t nSamples,
+                     State& state,
+                     const SystemParameters& sysParams,
+                     const PedalState& pedal) const
 {
     if (pedal.sostenutoTrigger)
     {
@@ -159,13 +290,46 @@ Note::update(SampleT* sample,
         return;
     }
 
+    (this->*renderFunc_)(sample, nSamples, state, sysParams);
+}
+
+template <int HAMMER_ORDER>
+void
+Note::Kernel::updateHammer(Hammer::State& s,
+                           const Hammer::VelocityT& vin,
+                           const SystemParameters& sysParams) const
+{
+    switch (HAMMER_ORDER ? HAMMER_ORDER : hammerOrder_)
+    {
+    case 1:
+        hammer_.update(s, vin, sysParams);
+        break;
+
+    case 2:
+        hammer_.update2(s, vin, sysParams);
+        break;
+
+    default:
+        hammer_.update4(s, vin, sysParams);
+        break;
+    }
+}
+
+template <int N_STRINGS, int FRAC_ORDER, int M, int HAMMER_ORDER>
+void
+Note::Kernel::render(SampleT* sample,
+                     uint32_t nSamples,
+                     State& state,
+                     const SystemParameters& sysParams) const
+{
+    const int nStrings  = N_STRINGS ? N_STRINGS : nStrings_;
     uint32_t hammerMask = 0;
 
     while (nSamples)
     {
         String::StringSampleT vString = 0;
         String::StringSampleT load    = 0;
-        for (int i = 0; i < nStrings_; ++i)
+        for (int i = 0; i < nStrings; ++i)
         {
             const auto& s = strings_[i];
             auto& ss      = state.strings[i];
@@ -175,26 +339,27 @@ Note::update(SampleT* sample,
             add(load, load, s.getBridgeInputVelocity(ss));
         }
 
+        // load (Q20) * bridgeLoadRatio_ (Q25) は 32bit を超える
         String::BridgeSampleT bload;
-        mul(bload, load, bridgeLoadRatio_);
+        mulWide(bload, load, bridgeLoadRatio_);
 
         Hammer::VelocityT vStringAve;
         FixedPoint<int32_t, 18> vStringTmp = vString;
         mul(vStringAve, vStringTmp, _nStrings_);
         if (!state.hammer.idle)
         {
-            //            hammer_.update4(state.hammer, vStringAve, sysParams);
-            (hammer_.*hammerUpdateFunc_)(state.hammer, vStringAve, sysParams);
+            updateHammer<HAMMER_ORDER>(state.hammer, vStringAve, sysParams);
         }
 
         const auto& hload = state.hammer.F_2Z;
-        hammerMask |= getAbsMask(hload);
+        addAbsMask(hammerMask, hload);
 
-        for (int i = 0; i < nStrings_; ++i)
+        for (int i = 0; i < nStrings; ++i)
         {
             add(*sample,
                 *sample,
-                strings_[i].update(state.strings[i], bload, hload));
+                strings_[i].template update<FRAC_ORDER, M>(
+                    state.strings[i], bload, hload));
         }
         ++sample;
         --nSamples;
@@ -8,6 +8,7 @@
 #include "hammer.h"
 #include "pedal.h"
 #include "string.h"
+#include <utility>
 #include <vector>
 
 namespace physical_modeling_piano
@@ -25,37 +26,127 @@ public:
         String::State strings[3];
         Hammer::State hammer;
 
-        std::vector<uint32_t> allocatorBuffer_;
+        void* buffer_{};
+        size_t bufferSize_{};
+        bool bufferCleared_{}; // buffer_ が全て 0 になっている
 
     public:
-        void initialize(size_t allocatorSize);
+        // keyOn で弦の遅延線を確保するメモリ
+        void attachBuffer(void* p, size_t size, bool cleared = false);
+        void* getBuffer() const { return buffer_; }
 
         bool keyOn{};
         bool sostenuto{};
         bool idle{};
     };
 
+    // 描画中に毎サンプル参照する係数と描画関数
+    // NoteManager はキーオン時にこれだけをボイスの State の隣に複製する
+    class Kernel
+    {
+    public:
+        void update(SampleT* sample,
+                    uint32_t nSamples,
+                    State& state,
+                    const SystemParameters& sysParams,
+                    const PedalState& pedal) const;
+
+    private:
+        // 各テンプレート引数が 0 のものは実行時の値で処理する
+        template <int N_STRINGS, int FRAC_ORDER, int M, int HAMMER_ORDER>
+        void render(SampleT* sample,
+                    uint32_t nSamples,
+                    State& state,
+                    const SystemParameters& sysParams) const;
+
+        template <int HAMMER_ORDER>
+        void updateHammer(Hammer::State& s,
+                          const Hammer::VelocityT& vin,
+                          const SystemParameters& sysParams) const;
+
+        using RenderFunc = void (Kernel::*)(SampleT* sample,
+                                            uint32_t nSamples,
+                                            State& state,
+                                            const SystemParameters& sysParams)
+            const;
+
+        // FRAC_ORDERS に fracOrder が無ければ nullptr
+        template <int N_STRINGS, int M, int HAMMER_ORDER, int... FRAC_ORDERS>
+        static RenderFunc
+        selectRenderFunc(int fracOrder,
+                         std::integer_sequence<int, FRAC_ORDERS...>);
+        static RenderFunc
+        selectRenderFunc(int nStrings, int fracOrder, int M, int hammerOrder);
+        void restoreRenderFunc();
+
+    private:
+        int nStrings_{};
+        FixedPoint<int32_t, 8> _nStrings_;
+        FixedPoint<int32_t, 25> bridgeLoadRatio_;
+
+        String strings_[3];
+        Hammer hammer_;
+        int hammerOrder_{};
+        RenderFunc renderFunc_{};
+
+        friend class Note;
+    };
+
 public:
     void initialize(float freq, const SystemParameters& sysParams);
     size_t computeAllocatorSize() const;
 
+    int getStringCount() const { return kernel_.nStrings_; }
+    const String& getString(int i) const { return kernel_.strings_[i]; }
+    // 弦ごとの共振周波数の目標からのずれ [cent]
+    float computePitchError(int i, const SystemParameters& sysParams) const;
+
+    const Kernel& getKernel() const { return kernel_; }
+
     void keyOn(State& state, float v) const;
+    // 鳴っている弦はそのままでハンマーだけ打ち直す
+    void restrike(State& state, float v) const;
     void keyOff(State& state) const;
 
+    // 係数の保存と復元 (note_table)、読み込んだら描画関数も選び直す
+    template <class Archive>
+    void serializeCoefficients(Archive& ar)
+    {
+        ar(freq_);
+        ar(kernel_.nStrings_);
+        ar(kernel_._nStrings_);
+        ar(kernel_.bridgeLoadRatio_);
+        for (int i = 0; i < kernel_.nStrings_; ++i)
+        {
+            kernel_.strings_[i].serializeCoefficients(ar);
+            ar(storageHeadroomBits_[i]);
+        }
+        kernel_.hammer_.serializeCoefficients(ar);
+        ar(kernel_.hammerOrder_);
+        if (Archive::LOADING)
+        {
+            kernel_.restoreRenderFunc();
+        }
+    }
+
     void update(SampleT* sample,
                 uint32_t nSamples,
                 State& state,
                 const SystemParameters& sysParams,
-                const PedalState& pedal) const;
+                const PedalState& pedal) const
+    {
+        kernel_.update(sample, nSamples, state, sysParams, pedal);
+    }
+
+private:
+    int computeDelayStorageShift(int i, float v) const;
 
 private:
-    int nStrings_{};
-    FixedPoint<int32_t, 8> _nStrings_;
-    FixedPoint<int32_t, 25> bridgeLoadRatio_;
+    Kernel kernel_;
 
-    String strings_[3];
-    Hammer hammer_;
-    Hammer::UpdateFunc hammerUpdateFunc_;
+    // 以下は初期化とキーオン時にしか使わない
+    float freq_{};
+    int8_t storageHeadroomBits_[3]{};
 };
 
 } // namespace physical_modeling_piano
@@ -6,6 +6,12 @@
 #include "note_manager.h"
 #include <algorithm>
 #include <assert.h>
+#include <math.h>
+#include <new>
+#include <string.h>
+#include <system/trace.h>
+#include <system/util.h>
+#include <type_traits>
 
 namespace physical_modeling_piano
 {
@@ -14,41 +20,162 @@ namespace
 {
 enum Event
 {
-    START = 1 << 0,
-    SYNC  = 1 << 1,
+    START   = 1 << 0,
+    SYNC    = 1 << 1,
+    CLEAR   = 1 << 2, // 解放したメモリのクリア依頼
+    CLEARED = 1 << 3, // worker がメモリを 1つクリアし終えた
 };
 }
 
 void
-NoteManager::initialize(const SystemParameters& sysParams, size_t nPoly)
+NoteManager::initialize(const SystemParameters& sysParams,
+                        size_t nPoly,
+                        size_t memorySize,
+                        size_t maxSamples,
+                        const void* noteTable,
+                        size_t noteTableSize,
+                        NoteTableStorage* storage)
 {
-    size_t allocatorSize = 0;
-
-    for (int i = 0; i < N_NOTES; ++i)
+    onsetTimeout_ = sysParams.sampleRate; // 1秒
+
+    // 計算済みの表が使えればフィルタの設計などを省く
+    // 埋め込みの表 -> storage の表 -> 計算 (storage に置く) の順
+    auto t0            = sys::micros();
+    const char* source = "computed";
+    if (noteTable && loadNoteTable(notes_.data(),
+                                   N_NOTES,
+                                   sysParams,
+                                   noteTable,
+                                   noteTableSize))
+    {
+        source = "loaded";
+    }
+    else
     {
-        float f = 440 * powf(2.0f, (i + NOTE_BEGIN - 69) / 12.0f);
-        notes_[i].initialize(f, sysParams);
+        std::vector<uint8_t> table;
+        if (storage && storage->load(table) &&
+            loadNoteTable(notes_.data(),
+                          N_NOTES,
+                          sysParams,
+                          table.data(),
+                          table.size()))
+        {
+            source = "restored";
+        }
+        else
+        {
+            computeNotes(notes_.data(), N_NOTES, NOTE_BEGIN, sysParams);
+            if (storage)
+            {
+                table = saveNoteTable(notes_.data(), N_NOTES, sysParams);
+                if (!storage->save(table))
+                {
+                    printf("note table: save failed (%zd bytes)\n",
+                           table.size());
+                }
+            }
+        }
+    }
+    printf("notes %s in %u us\n", source, unsigned(sys::micros() - t0));
 
-        allocatorSize =
-            std::max(allocatorSize, notes_[i].computeAllocatorSize());
+    size_t allocatorSize = 0;
+    for (auto& note : notes_)
+    {
+        allocatorSize = std::max(allocatorSize, note.computeAllocatorSize());
     }
 
-    printf("note %zd bytes, notes %zd, st %zd, allocator %zd\n",
+    printf("note %zd bytes (kernel %zd), notes %zd, st %zd, allocator %zd\n",
            sizeof(Note),
+           sizeof(Note::Kernel),
            sizeof(notes_),
            sizeof(Note::State),
            allocatorSize);
 
+    // 予算の配分 (/16)
+    // 低音の和音で足りなくならないよう最大のクラスを厚くする
+    // 最大のクラスは最低音が必ず鳴らせるように 1つは確保する
+    static constexpr int memoryShares[N_MEMORY_CLASSES] = {10, 3, 2, 1};
+
+    size_t unitSizes[N_MEMORY_CLASSES];
+    size_t unitCounts[N_MEMORY_CLASSES];
+    size_t unitSize = allocatorSize;
+    for (int i = 0; i < N_MEMORY_CLASSES; ++i)
+    {
+        unitSize = (unitSize + 3) & ~3;
+
+        size_t share  = memorySize * memoryShares[i] / 16;
+        unitSizes[i]  = unitSize;
+        unitCounts[i] = std::max<size_t>(share / unitSize, i == 0 ? 1 : 0);
+        printf("memory class %d: %zd bytes x %zd\n",
+               i,
+               unitSize,
+               unitCounts[i]);
+
+        unitSize /= 2;
+    }
+
+    // ノードと遅延線のプールを 1 つの領域に並べる
+    // 以降、発音中にヒープは使わない
+    static_assert(std::is_trivially_destructible<Node>::value, "");
+    constexpr size_t ALIGN = 16;
+    auto alignSize = [](size_t s) { return (s + ALIGN - 1) & ~(ALIGN - 1); };
+
+    size_t nUnits = 0;
+    for (auto n : unitCounts)
+    {
+        nUnits += n;
+    }
+    auto ringSize = alignSize(MemoryRing::computeBufferSize(nUnits));
+
+    size_t arenaSize = alignSize(sizeof(Node) * nPoly) + ringSize * 2;
+    for (int i = 0; i < N_MEMORY_CLASSES; ++i)
+    {
+        arenaSize += alignSize(
+            PoolAllocator::computeBufferSize(unitSizes[i], unitCounts[i]));
+    }
+    arena_.resize((arenaSize + ALIGN) / sizeof(arena_[0]));
+    printf("voice arena %zd bytes\n", arenaSize);
+
+    SimpleLinearAllocator arena(arena_.data(),
+                                arena_.size() * sizeof(arena_[0]));
+    nodes_  = new (arena.allocate(sizeof(Node) * nPoly, ALIGN)) Node[nPoly];
+    nNodes_ = nPoly;
+    dirtyMemory_.attachBuffer(
+        static_cast<void**>(arena.allocate(ringSize, ALIGN)), nUnits + 1);
+    clearedMemory_.attachBuffer(
+        static_cast<void**>(arena.allocate(ringSize, ALIGN)), nUnits + 1);
+    for (int i = 0; i < N_MEMORY_CLASSES; ++i)
+    {
+        auto size =
+            PoolAllocator::computeBufferSize(unitSizes[i], unitCounts[i]);
+        memoryPools_[i].initialize(
+            arena.allocate(size, ALIGN), unitSizes[i], unitCounts[i]);
+    }
+
+    for (size_t i = 0; i < N_NOTES; ++i)
+    {
+        auto size = notes_[i].computeAllocatorSize();
+        int c     = 0;
+        while (c + 1 < N_MEMORY_CLASSES &&
+               memoryPools_[c + 1].getUnitCount() &&
+               size <= memoryPools_[c + 1].getUnitSize())
+        {
+            ++c;
+        }
+        noteMemoryClass_[i] = c;
+    }
+
     std::fill(noteNode_.begin(), noteNode_.end(), -1);
 
-    nodes_.resize(nPoly);
-    for (auto&& n : nodes_)
+    for (size_t i = 0; i < nNodes_; ++i)
     {
-        n.state_.initialize(allocatorSize);
-        freeNode(&n);
+        freeNode(&nodes_[i]);
     }
 
-    workNodes_.resize(nPoly);
+    // update 中にヒープを触らないように最大サイズで確保しておく
+    workNodes_.reserve(nPoly);
+    workerSamples_.resize(maxSamples);
+    onsetWork_.resize(maxSamples);
 
     //
     eventGroupHandle_ = xEventGroupCreate();
@@ -76,7 +203,7 @@ NoteManager::update(Note::SampleT* samples,
     {
         //        printf("update %p, %d\n", node, getNodeIndex(node));
         auto noteIdx = node->noteIndex_;
-        notes_[noteIdx].update(
+        node->kernel_.update(
             samples, nSamples, node->state_, sysParams, pedal);
 
         if (node->state_.idle)
@@ -95,6 +222,22 @@ NoteManager::update(Note::SampleT* samples,
         }
     }
 #else
+    TRACE_BEGIN(NOTE_UPDATE, 0);
+    if (onsetNote_ >= 0 && !onsetNode_)
+    {
+        // watchOnset の後の keyOn で割り当てられたもの
+        auto idx = noteNode_[onsetNote_];
+        if (idx >= 0)
+        {
+            onsetNode_ = &nodes_[idx];
+        }
+        else
+        {
+            onsetNote_ = -1;
+        }
+    }
+    onsetIndex_ = -1;
+
     workNodes_.clear();
     auto* node = active_;
     while (node)
@@ -103,38 +246,42 @@ NoteManager::update(Note::SampleT* samples,
         node = node->next_;
     }
 
-    workerSamples_.resize(nSamples);
-    std::fill(workerSamples_.begin(), workerSamples_.end(), 0);
+    assert(nSamples <= workerSamples_.size());
+    workerSampleCount_ = nSamples;
+    std::fill(workerSamples_.begin(), workerSamples_.begin() + nSamples, 0);
 
     currentSysParams_  = &sysParams;
     currentPedalState_ = &pedal;
 
     workIdx_.store(0, std::memory_order_release);
 
+    TRACE_INSTANT(WORKER_START, 0);
     xEventGroupSetBits(eventGroupHandle_, Event::START);
     int nn = process(samples, nSamples);
     //    printf("mn = %d\n", nn);
     (void)nn;
 
+    TRACE_BEGIN(SYNC_WAIT, 0);
     xEventGroupWaitBits(eventGroupHandle_,
                         Event::SYNC,
                         pdTRUE /* clear */,
                         pdFALSE /* wait for all bit */,
                         portMAX_DELAY);
+    TRACE_END(SYNC_WAIT, 0);
+
+    updateOnset(nSamples);
 
-    int n = 0;
-    node  = active_;
+    int n         = 0;
+    bool released = false;
+    node          = active_;
     while (node)
     {
         if (node->state_.idle)
         {
-            noteNode_[node->noteIndex_]          = -1;
-            keyOnStateForDisp_[node->noteIndex_] = false;
-
             auto next = node->next_;
-            removeActive(node);
-            freeNode(node);
-            node = next;
+            releaseNode(node, true /* defer clear */);
+            node     = next;
+            released = true;
         }
         else
         {
@@ -144,6 +291,12 @@ NoteManager::update(Note::SampleT* samples,
     }
     currentNoteCount_ = n;
 
+    if (released)
+    {
+        xEventGroupSetBits(eventGroupHandle_, Event::CLEAR);
+    }
+    collectClearedMemory();
+
     const auto* ws = workerSamples_.data();
     do
     {
@@ -151,6 +304,7 @@ NoteManager::update(Note::SampleT* samples,
         ++samples;
         ++ws;
     } while (--nSamples);
+    TRACE_END(NOTE_UPDATE, 0);
 
 #endif
 }
@@ -168,17 +322,93 @@ NoteManager::process(Note::SampleT* samples, size_t nSamples)
             return ct;
         }
 
-        auto* node   = workNodes_[idx];
-        auto noteIdx = node->noteIndex_;
-        notes_[noteIdx].update(samples,
-                               nSamples,
-                               node->state_,
-                               *currentSysParams_,
-                               *currentPedalState_);
+        auto* node = workNodes_[idx];
+        TRACE_BEGIN(VOICE, node->noteIndex_ + NOTE_BEGIN);
+        if (node == onsetNode_)
+        {
+            processOnsetNode(node, samples, nSamples);
+        }
+        else
+        {
+            node->kernel_.update(samples,
+                                 nSamples,
+                                 node->state_,
+                                 *currentSysParams_,
+                                 *currentPedalState_);
+        }
+        TRACE_END(VOICE, node->noteIndex_ + NOTE_BEGIN);
         ++ct;
     }
 }
 
+void
+NoteManager::processOnsetNode(Node* node,
+                              Note::SampleT* samples,
+                              size_t nSamples)
+{
+    // 他の音と混ぜる前の出力を調べる
+    // 固定小数点なら足す順番が変わっても結果は同じ
+    auto* work = onsetWork_.data();
+    std::fill(work, work + nSamples, 0);
+    node->kernel_.update(
+        work, nSamples, node->state_, *currentSysParams_, *currentPedalState_);
+
+    for (size_t i = 0; i < nSamples; ++i)
+    {
+        if (fabsf(work[i]) >= onsetThreshold_)
+        {
+            onsetIndex_ = i;
+            break;
+        }
+    }
+    for (size_t i = 0; i < nSamples; ++i)
+    {
+        add(samples[i], samples[i], work[i]);
+    }
+}
+
+bool
+NoteManager::watchOnset(int note, float threshold)
+{
+    note -= NOTE_BEGIN;
+    if (note < 0 || note >= int(N_NOTES) || noteNode_[note] >= 0)
+    {
+        return false;
+    }
+
+    onsetNote_      = note;
+    onsetNode_      = nullptr;
+    onsetThreshold_ = threshold;
+    onsetElapsed_   = 0;
+    onsetSamples_   = -1;
+    return true;
+}
+
+void
+NoteManager::updateOnset(size_t nSamples)
+{
+    if (!onsetNode_)
+    {
+        return;
+    }
+
+    if (onsetIndex_ >= 0)
+    {
+        onsetSamples_ = onsetElapsed_ + onsetIndex_;
+        onsetNote_    = -1;
+        onsetNode_    = nullptr;
+        return;
+    }
+
+    // 1秒たっても出なければあきらめる
+    onsetElapsed_ += nSamples;
+    if (onsetElapsed_ > onsetTimeout_)
+    {
+        onsetNote_ = -1;
+        onsetNode_ = nullptr;
+    }
+}
+
 void
 NoteManager::workerEntry(void* p)
 {
@@ -190,17 +420,30 @@ NoteManager::worker()
 {
     while (1)
     {
-        xEventGroupWaitBits(eventGroupHandle_,
-                            Event::START,
-                            pdTRUE /* clear */,
-                            pdFALSE /* wait for all bit */,
-                            portMAX_DELAY);
+        auto bits = xEventGroupWaitBits(eventGroupHandle_,
+                                        Event::START | Event::CLEAR,
+                                        pdTRUE /* clear */,
+                                        pdFALSE /* wait for all bit */,
+                                        portMAX_DELAY);
+
+        if (bits & Event::START)
+        {
+            TRACE_BEGIN(WORKER, 0);
+            int nn = process(workerSamples_.data(), workerSampleCount_);
+            //        printf("wn %d\n", nn);
+            (void)nn;
+            TRACE_END(WORKER, 0);
 
-        int nn = process(workerSamples_.data(), workerSamples_.size());
-        //        printf("wn %d\n", nn);
-        (void)nn;
+            xEventGroupSetBits(eventGroupHandle_, Event::SYNC);
+        }
 
-        xEventGroupSetBits(eventGroupHandle_, Event::SYNC);
+        // 描画の合間に解放されたメモリを 0 にしておく
+        if (!dirtyMemory_.empty())
+        {
+            TRACE_BEGIN(MEMORY_CLEAR, 0);
+            clearDirtyMemory();
+            TRACE_END(MEMORY_CLEAR, 0);
+        }
     }
 }
 
@@ -219,25 +462,68 @@ NoteManager::keyOn(int note, float v)
     {
         node = &nodes_[nodeIndex];
         assert(node->noteIndex_ == note);
+
+        // 鳴っている弦に打ち直す
+        // keyOff で先頭 (次に止める候補) に移されているので末尾に戻す
+        TRACE_INSTANT(RESTRIKE, note + NOTE_BEGIN);
+        notes_[note].restrike(node->state_, v);
+        removeActive(node);
+        pushActive(node);
     }
     else
     {
+        TRACE_INSTANT(KEY_ON, note + NOTE_BEGIN);
         node = allocateNode();
         if (!node)
         {
-            node = popFrontActive();
-
-            noteNode_[node->noteIndex_]          = -1;
-            keyOnStateForDisp_[node->noteIndex_] = false;
+            TRACE_INSTANT(STEAL, active_->noteIndex_ + NOTE_BEGIN);
+            releaseNode(active_);
+            node = allocateNode();
         }
         assert(node);
 
+        // メモリが足りなければクリア待ちのものをここでクリアして使う
+        // worker がクリア中のものがあればそれを待ち、
+        // それも無ければ古いものから止める
+        while (1)
+        {
+            collectClearedMemory();
+            if (allocateMemory(node, note))
+            {
+                break;
+            }
+            if (reclaimDirtyMemory())
+            {
+                continue;
+            }
+            if (clearingMemoryCount_ > 0)
+            {
+                xEventGroupWaitBits(eventGroupHandle_,
+                                    Event::CLEARED,
+                                    pdTRUE /* clear */,
+                                    pdFALSE /* wait for all bit */,
+                                    portMAX_DELAY);
+                continue;
+            }
+
+            auto* victim = findStealNode(noteMemoryClass_[note]);
+            if (!victim)
+            {
+                // 足りるメモリを持つボイスが無いので、この音は鳴らさない
+                freeNode(node);
+                return;
+            }
+            TRACE_INSTANT(STEAL, victim->noteIndex_ + NOTE_BEGIN);
+            releaseNode(victim);
+        }
+
         node->noteIndex_ = note;
+        node->kernel_    = notes_[note].getKernel();
         noteNode_[note]  = getNodeIndex(node);
         pushActive(node);
-    }
 
-    notes_[note].keyOn(node->state_, v);
+        notes_[note].keyOn(node->state_, v);
+    }
     keyOnStateForDisp_[note] = true;
 
     // printf("allocated node: %p, idx %d, note %d\n",
@@ -263,6 +549,7 @@ NoteManager::keyOff(int note)
     auto* node = &nodes_[nodeIndex];
     assert(node->noteIndex_ == note);
 
+    TRACE_INSTANT(KEY_OFF, note + NOTE_BEGIN);
     notes_[note].keyOff(node->state_);
 
     // 先頭に持っていく
@@ -277,7 +564,144 @@ NoteManager::keyOff(int note)
 int
 NoteManager::getNodeIndex(Node* node) const
 {
-    return node - nodes_.data();
+    return node - nodes_;
+}
+
+bool
+NoteManager::allocateMemory(Node* node, int noteIndex)
+{
+    // 足りなければ大きいクラスから借りる
+    for (int c = noteMemoryClass_[noteIndex]; c >= 0; --c)
+    {
+        if (auto* p = memoryPools_[c].allocate())
+        {
+            // 先頭は空きリストのリンクに使われているので、そこだけ消せば全て 0
+            *static_cast<uint32_t*>(p) = 0;
+
+            node->memoryClass_ = c;
+            node->state_.attachBuffer(
+                p, memoryPools_[c].getUnitSize(), true /* cleared */);
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+NoteManager::freeMemory(Node* node, bool deferClear)
+{
+    if (node->memoryClass_ < 0)
+    {
+        return;
+    }
+
+    auto* p = node->state_.getBuffer();
+    node->state_.attachBuffer(nullptr, 0);
+    node->memoryClass_ = -1;
+
+    if (deferClear && dirtyMemory_.push(p))
+    {
+        ++clearingMemoryCount_;
+    }
+    else
+    {
+        clearMemory(p);
+        getMemoryPool(p).free(p);
+    }
+}
+
+void
+NoteManager::releaseNode(Node* node, bool deferClear)
+{
+    noteNode_[node->noteIndex_]          = -1;
+    keyOnStateForDisp_[node->noteIndex_] = false;
+
+    if (node == onsetNode_)
+    {
+        onsetNote_ = -1;
+        onsetNode_ = nullptr;
+    }
+
+    removeActive(node);
+    freeMemory(node, deferClear);
+    freeNode(node);
+}
+
+PoolAllocator&
+NoteManager::getMemoryPool(void* p)
+{
+    for (auto& pool : memoryPools_)
+    {
+        if (pool.contains(p))
+        {
+            return pool;
+        }
+    }
+    assert(0);
+    return memoryPools_[0];
+}
+
+void
+NoteManager::clearMemory(void* p)
+{
+    memset(p, 0, getMemoryPool(p).getUnitSize());
+}
+
+// worker 側
+void
+NoteManager::clearDirtyMemory()
+{
+    void* p;
+    while (dirtyMemory_.pop(&p))
+    {
+        clearMemory(p);
+        bool r = clearedMemory_.push(p);
+        assert(r);
+        (void)r;
+        xEventGroupSetBits(eventGroupHandle_, Event::CLEARED);
+    }
+}
+
+// worker がクリアし終えたものをプールに戻す
+void
+NoteManager::collectClearedMemory()
+{
+    void* p;
+    while (clearedMemory_.pop(&p))
+    {
+        getMemoryPool(p).free(p);
+        --clearingMemoryCount_;
+    }
+}
+
+// worker がまだ手を付けていないものを取り戻して自分でクリアする
+bool
+NoteManager::reclaimDirtyMemory()
+{
+    void* p;
+    if (!dirtyMemory_.pop(&p))
+    {
+        return false;
+    }
+    clearMemory(p);
+    getMemoryPool(p).free(p);
+    --clearingMemoryCount_;
+    return true;
+}
+
+// memoryClass 以上のメモリを持つもののうち一番古いもの、無ければ nullptr
+// それ以外を止めても memoryClass のメモリは空かない
+NoteManager::Node*
+NoteManager::findStealNode(int memoryClass) const
+{
+    for (auto* node = active_; node; node = node->next_)
+    {
+        if (node->memoryClass_ <= memoryClass)
+        {
+            return node;
+        }
+    }
+    return nullptr;
 }
 
 NoteManager::Node*
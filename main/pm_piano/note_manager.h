@@ -5,8 +5,11 @@
 #ifndef _103DE5E1_1134_152A_154E_889BBA4369C5
 #define _103DE5E1_1134_152A_154E_889BBA4369C5
 
+#include "allocator.h"
 #include "note.h"
+#include "note_table.h"
 #include "pedal.h"
+#include "spsc_ring.h"
 #include "sys_params.h"
 #include <array>
 #include <atomic>
@@ -29,16 +32,36 @@ class NoteManager
     std::array<int8_t, N_NOTES> noteNode_;
     std::array<bool, N_NOTES> keyOnStateForDisp_;
 
+    // 遅延線メモリのサイズクラス数 (大きい順、1段ごとに 1/2)
+    static constexpr int N_MEMORY_CLASSES = 4;
+
+    std::array<PoolAllocator, N_MEMORY_CLASSES> memoryPools_;
+
+    // 解放したメモリは worker が 0 にしてから戻す
+    // キーオン時には遅延線をクリアしなくて済む
+    using MemoryRing = SPSCRing<void*>;
+    MemoryRing dirtyMemory_;   // 音声タスク -> worker
+    MemoryRing clearedMemory_; // worker -> 音声タスク
+    std::array<int8_t, N_NOTES> noteMemoryClass_;
+    // dirtyMemory_ に入れてまだプールに戻していない数 (音声タスク側で数える)
+    int clearingMemoryCount_{};
+
     struct Node
     {
         Note::State state_;
+        // 描画中に参照する係数だけをキーオン時に State の隣に複製する
+        // キーオンなどそれ以外は notes_[noteIndex_] を使う
+        Note::Kernel kernel_;
         int noteIndex_{};
+        int memoryClass_{-1};
 
         Node* prev_{};
         Node* next_{};
     };
 
-    std::vector<Node> nodes_;
+    std::vector<uint64_t> arena_; // nodes_ と遅延線のプール
+    Node* nodes_{};
+    size_t nNodes_{};
     Node* free_{};   // 片方向
     Node* active_{}; // 双方向
     Node* activeTail_{};
@@ -49,14 +72,35 @@ class NoteManager
     std::atomic<int> workIdx_;
 
     std::vector<Note::SampleT> workerSamples_{};
+    size_t workerSampleCount_{};
 
     size_t currentNoteCount_{};
 
+    // 遅延計測用に 1音だけ最初に出力が出たところを調べる
+    int onsetNote_{-1};
+    Node* onsetNode_{};
+    float onsetThreshold_{};
+    int onsetElapsed_{};
+    int onsetSamples_{-1};
+    int onsetIndex_{-1}; // 見つけたブロック内の位置
+    int onsetTimeout_{};
+    std::vector<Note::SampleT> onsetWork_;
+
     TaskHandle_t workerTaskHandle_{};
     EventGroupHandle_t eventGroupHandle_{};
 
 public:
-    void initialize(const SystemParameters& sysParams, size_t nPoly);
+    // memorySize: 全ボイスで共有する遅延線メモリの予算 [byte]
+    // maxSamples: update 1回で処理する最大サンプル数
+    // noteTable: saveNoteTable で作った表、sysParams のものでなければ
+    // storage から読み、それも合わなければ計算して storage に置く
+    void initialize(const SystemParameters& sysParams,
+                    size_t nPoly,
+                    size_t memorySize,
+                    size_t maxSamples,
+                    const void* noteTable     = nullptr,
+                    size_t noteTableSize      = 0,
+                    NoteTableStorage* storage = nullptr);
     void keyOn(int note, float v);
     void keyOff(int note);
 
@@ -65,7 +109,16 @@ public:
                 const SystemParameters& sysParams,
                 const PedalState& pedal);
 
+    // 次の keyOn(note) からその音の出力が threshold 以上になるまでを計る
+    // 既に鳴っている音 (打ち直し) は計らない
+    bool watchOnset(int note, float threshold);
+    bool isWatchingOnset() const { return onsetNote_ >= 0; }
+    // watchOnset からのサンプル数、まだ出ていなければ -1
+    int getOnsetSamples() const { return onsetSamples_; }
+
     size_t getCurrentNoteCount() const { return currentNoteCount_; }
+    // 鳴っている (update で描画する) ボイスがあるか
+    bool hasActiveNodes() const { return active_ != nullptr; }
     const std::array<bool, N_NOTES>& getKeyOnStateForDisp() const
     {
         return keyOnStateForDisp_;
@@ -81,7 +134,20 @@ protected:
     Node* popFrontActive();
     void removeActive(Node* node);
 
+    bool allocateMemory(Node* node, int noteIndex);
+    void freeMemory(Node* node, bool deferClear);
+    void releaseNode(Node* node, bool deferClear = false);
+    Node* findStealNode(int memoryClass) const;
+
+    PoolAllocator& getMemoryPool(void* p);
+    void clearMemory(void* p);
+    void clearDirtyMemory();
+    void collectClearedMemory();
+    bool reclaimDirtyMemory();
+
     int process(Note::SampleT* samples, size_t nSamples);
+    void processOnsetNode(Node* node, Note::SampleT* samples, size_t nSamples);
+    void updateOnset(size_t nSamples);
 
     static void workerEntry(void* p);
     void worker();
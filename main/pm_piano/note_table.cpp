@@ -0,0 +1,146 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 5:31:8
+ */
+
+#include "note_table.h"
+#include "coef_archive.h"
+#include <math.h>
+
+namespace physical_modeling_piano
+{
+
+namespace
+{
+constexpr uint32_t MAGIC     = 0x544e4d50; // "PMNT"
+constexpr uint32_t VERSION   = 3; // 係数の並びや意味を変えたら上げる
+constexpr int HEADER_WORDS   = 5;
+constexpr size_t HEADER_SIZE = HEADER_WORDS * 4;
+
+// FNV-1a
+uint32_t
+hashBytes(const void* p, size_t size)
+{
+    auto* b    = static_cast<const uint8_t*>(p);
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+    {
+        h = (h ^ b[i]) * 16777619u;
+    }
+    return h;
+}
+
+} // namespace
+
+uint32_t
+computeNoteTableKey(const SystemParameters& sysParams)
+{
+    std::vector<uint8_t> bytes;
+    CoefWriter ar(bytes);
+
+    ar(VERSION);
+    ar(USE_FIXED_POINT);
+    ar(USE_EXACT_DELAY_BUFFER);
+    ar(USE_COMPRESSED_DELAY_BUFFER);
+    ar(int(String::MAX_FRAC_DELAY_ORDER));
+    ar(int(String::MAX_DISPERSION_STAGES));
+
+    ar(sysParams.youngsModulus);
+    ar(sysParams.stringDensity);
+    ar(sysParams.bridgeImpedance);
+    ar(sysParams.stringLossC1);
+    ar(sysParams.stringLossC3);
+    ar(sysParams.soundboardLossC1);
+    ar(sysParams.soundboardLossC3);
+    ar(sysParams.soundboardFeedback);
+    ar(sysParams.hammerPosition);
+    for (auto t : sysParams.tune)
+    {
+        ar(t);
+    }
+    ar(int(sysParams.tuningFilter));
+    ar(sysParams.sampleRate);
+
+    return hashBytes(bytes.data(), bytes.size());
+}
+
+void
+computeNotes(Note* notes,
+             int nNotes,
+             int noteBegin,
+             const SystemParameters& sysParams)
+{
+    for (int i = 0; i < nNotes; ++i)
+    {
+        float f = 440 * powf(2.0f, (i + noteBegin - 69) / 12.0f);
+        notes[i].initialize(f, sysParams);
+    }
+}
+
+std::vector<uint8_t>
+saveNoteTable(const Note* notes, int nNotes, const SystemParameters& sysParams)
+{
+    std::vector<uint8_t> coefs;
+    CoefWriter ar(coefs);
+    for (int i = 0; i < nNotes; ++i)
+    {
+        // 書き出しでは変更しない
+        const_cast<Note&>(notes[i]).serializeCoefficients(ar);
+    }
+
+    const uint32_t header[HEADER_WORDS] = {MAGIC,
+                                           computeNoteTableKey(sysParams),
+                                           uint32_t(nNotes),
+                                           uint32_t(coefs.size()),
+                                           hashBytes(coefs.data(),
+                                                     coefs.size())};
+    std::vector<uint8_t> table;
+    table.reserve(HEADER_SIZE + coefs.size());
+    for (auto w : header)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            table.push_back(uint8_t(w >> (i * 8)));
+        }
+    }
+    table.insert(table.end(), coefs.begin(), coefs.end());
+    return table;
+}
+
+bool
+loadNoteTable(Note* notes,
+              int nNotes,
+              const SystemParameters& sysParams,
+              const void* data,
+              size_t size)
+{
+    if (!data || size < HEADER_SIZE)
+    {
+        return false;
+    }
+
+    auto* p = static_cast<const uint8_t*>(data);
+    uint32_t h[HEADER_WORDS]{};
+    for (size_t i = 0; i < HEADER_SIZE; ++i)
+    {
+        h[i / 4] |= uint32_t(p[i]) << (i % 4 * 8);
+    }
+
+    const uint8_t* coefs   = p + HEADER_SIZE;
+    const size_t coefBytes = size - HEADER_SIZE;
+    if (h[0] != MAGIC || h[1] != computeNoteTableKey(sysParams) ||
+        h[2] != uint32_t(nNotes) || h[3] != coefBytes ||
+        h[4] != hashBytes(coefs, coefBytes))
+    {
+        return false;
+    }
+
+    CoefReader ar(coefs, coefBytes);
+    for (int i = 0; i < nNotes; ++i)
+    {
+        notes[i].serializeCoefficients(ar);
+    }
+    return ar.isValid() && ar.getPointer() == coefs + coefBytes;
+}
+
+} // namespace physical_modeling_piano
@@ -0,0 +1,59 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 5:31:8
+ */
+#ifndef _16BEF58F_2E0B_4CC8_A80D_DEC0D5437E10
+#define _16BEF58F_2E0B_4CC8_A80D_DEC0D5437E10
+
+#include "note.h"
+#include "sys_params.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace physical_modeling_piano
+{
+
+// 全鍵の Note の係数を計算済みの表にする
+// 起動時に Note::initialize (フィルタの設計など) をやり直さずに読み込む
+//
+// 形式は 32bit (little endian) のヘッダ
+//   magic, key, 鍵数, 係数のバイト数, 係数のチェックサム
+// の後に係数 (coef_archive.h の可変長) が続く
+// key は SystemParameters と係数の型を決めるビルド設定から作るので
+// 合わない表は読まずに計算し直す
+uint32_t computeNoteTableKey(const SystemParameters& sysParams);
+
+// ノート番号 noteBegin から nNotes 鍵分を計算する (表が使えない場合)
+void computeNotes(Note* notes,
+                  int nNotes,
+                  int noteBegin,
+                  const SystemParameters& sysParams);
+
+std::vector<uint8_t> saveNoteTable(const Note* notes,
+                                   int nNotes,
+                                   const SystemParameters& sysParams);
+
+// 表が sysParams のもので壊れていなければ notes に読み込む
+// 読めなければ false で notes はそのまま
+bool loadNoteTable(Note* notes,
+                   int nNotes,
+                   const SystemParameters& sysParams,
+                   const void* data,
+                   size_t size);
+
+// 計算した表を置いておく場所 (NVS や host のファイル)
+// 1つだけ持ち、key が合わなくなったら計算し直して上書きする
+class NoteTableStorage
+{
+public:
+    virtual ~NoteTableStorage() = default;
+
+    // 無ければ false
+    virtual bool load(std::vector<uint8_t>& table) = 0;
+    virtual bool save(const std::vector<uint8_t>& table) = 0;
+};
+
+} // namespace physical_modeling_piano
+
+#endif /* _16BEF58F_2E0B_4CC8_A80D_DEC0D5437E10 */
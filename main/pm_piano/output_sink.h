@@ -0,0 +1,28 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 3:5:51
+ */
+#ifndef _97019849_50E3_43E7_9193_0822D3E9EBD1
+#define _97019849_50E3_43E7_9193_0822D3E9EBD1
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace physical_modeling_piano
+{
+
+// 響板の出力を受け取ってその場で出力形式 (ΔΣ, PCM など) に変換する
+// 響板の処理単位 (FDN なら最短の遅延長、畳み込みならパーティション) ごとに
+// 呼ぶので、ブロック全体の中間バッファを書いて読み直さなくて済む
+class OutputSink
+{
+public:
+    virtual ~OutputSink() = default;
+
+    // samples: 0 中心の 16bit 相当 (ResultT の生の値)、順に n サンプルずつ
+    virtual void write(const int32_t* samples, size_t n) = 0;
+};
+
+} // namespace physical_modeling_piano
+
+#endif /* _97019849_50E3_43E7_9193_0822D3E9EBD1 */
@@ -4,27 +4,88 @@
  */
 
 #include "piano.h"
+#include <algorithm>
+#include <assert.h>
+#include <stdio.h>
+#include <system/trace.h>
+#include <system/util.h>
 
 namespace physical_modeling_piano
 {
 
 void
-Piano::initialize(size_t nPoly)
+Piano::initialize(size_t nPoly,
+                  size_t memorySize,
+                  size_t maxSamples,
+                  uint32_t sampleRate)
 {
-    noteManager_.initialize(sysParams_, nPoly);
+    if (!sysParams_.setSampleRate(sampleRate))
+    {
+        printf("unsupported sample rate %u\n", unsigned(sampleRate));
+    }
+
+    noteManager_.initialize(sysParams_,
+                            nPoly,
+                            memorySize,
+                            maxSamples,
+                            noteTable_,
+                            noteTableSize_,
+                            noteTableStorage_);
     soundboard_.initialize(sysParams_);
+    latencyProbe_.initialize(sysParams_.sampleRate);
+    samples_.assign(maxSamples, 0);
 }
 
-void
+bool
 Piano::update(int32_t* samples, size_t nSamples, io::MidiMessageQueue& midiIn)
 {
     // 入出力は同じバッファで大丈夫
     static_assert(sizeof(Note::SampleT) == sizeof(int32_t), "");
-    static_assert(sizeof(Soundboard::ResultT) == sizeof(int32_t), "");
+    static_assert(sizeof(SoundboardT::ResultT) == sizeof(int32_t), "");
+
+    TRACE_BEGIN(BLOCK, 0);
+    auto* src = reinterpret_cast<Note::SampleT*>(samples);
+    if (!render(src, nSamples, midiIn))
+    {
+        TRACE_END(BLOCK, 1);
+        return false;
+    }
+
+    soundboard_.update(
+        reinterpret_cast<SoundboardT::ResultT*>(samples), src, nSamples);
+    TRACE_END(BLOCK, 0);
+    return true;
+}
+
+bool
+Piano::update(OutputSink& sink, size_t nSamples, io::MidiMessageQueue& midiIn)
+{
+    assert(nSamples <= samples_.size());
+
+    TRACE_BEGIN(BLOCK, 0);
+    auto* src = samples_.data();
+    if (!render(src, nSamples, midiIn))
+    {
+        TRACE_END(BLOCK, 1);
+        return false;
+    }
+
+    soundboard_.update(sink, src, nSamples);
+    TRACE_END(BLOCK, 0);
+    return true;
+}
+
+bool
+Piano::render(Note::SampleT* samples,
+              size_t nSamples,
+              io::MidiMessageQueue& midiIn)
+{
+    auto blockTime = sys::micros();
 
     io::MidiMessage m;
     while (midiIn.get(&m))
     {
+        TRACE_INSTANT(MIDI_GET, m.data[0] << 8 | m.data[1]);
         auto cmd = m.data[0] & 0xf0;
         if (cmd == 0x80)
         {
@@ -32,6 +93,14 @@ Piano::update(int32_t* samples, size_t nSamples, io::MidiMessageQueue& midiIn)
         }
         else if (cmd == 0x90)
         {
+            // 出力の 1LSB 相当を超えたところを音の出始めとする
+            constexpr float onsetThreshold = 1.0f / 32768;
+            if (latencyProbe_.isIdle() && m.timestamp && m.data[2] &&
+                noteManager_.watchOnset(m.data[1], onsetThreshold))
+            {
+                latencyProbe_.begin(m.timestamp, blockTime);
+            }
+
             float v = m.data[2] * (10 / 127.0f);
             noteManager_.keyOn(m.data[1], v);
         }
@@ -50,19 +119,34 @@ Piano::update(int32_t* samples, size_t nSamples, io::MidiMessageQueue& midiIn)
         }
     }
 
-    noteManager_.update(reinterpret_cast<Note::SampleT*>(samples),
-                        nSamples,
-                        sysParams_,
-                        pedal_);
+    if (!noteManager_.hasActiveNodes() && soundboard_.isSilent())
+    {
+        if (!idle_)
+        {
+            // 1/2 LSB 未満の残りを捨てて、次に鳴らすときは 0 から始める
+            soundboard_.clear();
+            idle_ = true;
+        }
+        return false;
+    }
+    idle_ = false;
+
+    std::fill(samples, samples + nSamples, 0);
+    noteManager_.update(samples, nSamples, sysParams_, pedal_);
 
-    soundboard_.update(reinterpret_cast<Soundboard::ResultT*>(samples),
-                       reinterpret_cast<Note::SampleT*>(samples),
-                       nSamples);
+    if (latencyProbe_.isWaitingOnset())
+    {
+        auto onset = noteManager_.getOnsetSamples();
+        if (onset >= 0)
+        {
+            latencyProbe_.setOnset(onset);
+        }
+        else if (!noteManager_.isWatchingOnset())
+        {
+            latencyProbe_.cancel();
+        }
+    }
+    return true;
 }
 
-SystemParameters::DeltaTimeT SystemParameters::deltaTF =
-    1.0f / SystemParameters::sampleRate;
-SystemParameters::DeltaTimeT SystemParameters::deltaT_2F =
-    0.5f / SystemParameters::sampleRate;
-
 } // namespace physical_modeling_piano
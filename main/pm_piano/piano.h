@@ -7,25 +7,69 @@
 
 #include "note_manager.h"
 #include "soundboard.h"
+#if SOUNDBOARD_CONVOLUTION
+#include "convolution_soundboard.h"
+#endif
 #include <io/midi.h>
+#include <system/latency_probe.h>
 
 namespace physical_modeling_piano
 {
 
 class Piano
 {
+#if SOUNDBOARD_CONVOLUTION
+    using SoundboardT = ConvolutionSoundboard;
+#else
+    using SoundboardT = Soundboard;
+#endif
+
     NoteManager noteManager_;
-    Soundboard soundboard_;
+    SoundboardT soundboard_;
 
     SystemParameters sysParams_;
     PedalState pedal_;
 
+    sys::LatencyProbe latencyProbe_;
+
+    std::vector<Note::SampleT> samples_; // sink に出力するときの響板への入力
+    bool idle_{};
+
+    const void* noteTable_{};
+    size_t noteTableSize_{};
+    NoteTableStorage* noteTableStorage_{};
+
 public:
     Piano() {}
 
-    void initialize(size_t nPoly);
-    void
+    // 計算済みの Note の係数 (note_table)、initialize より前に渡す
+    void setNoteTable(const void* data, size_t size)
+    {
+        noteTable_     = data;
+        noteTableSize_ = size;
+    }
+    // noteTable が合わないときに使う表の置き場 (initialize より前に渡す)
+    void setNoteTableStorage(NoteTableStorage* storage)
+    {
+        noteTableStorage_ = storage;
+    }
+
+    // sampleRate: SAMPLE_RATES のどれか (他は既定のものになる)
+    void initialize(size_t nPoly,
+                    size_t memorySize,
+                    size_t maxSamples,
+                    uint32_t sampleRate = DEFAULT_SAMPLE_RATE);
+    // false なら無音で samples には何も書かない
+    // 鳴っている音が無く響板の残響も消えている間は描画も worker も止める
+    bool
     update(int32_t* samples, size_t nSamples, io::MidiMessageQueue& midiIn);
+    // 響板の出力を sink に渡す (samples への書き出しと読み直しを省く)
+    // false なら無音で sink は呼ばない
+    bool
+    update(OutputSink& sink, size_t nSamples, io::MidiMessageQueue& midiIn);
+
+    bool isIdle() const { return idle_; }
+    uint32_t getSampleRate() const { return sysParams_.sampleRate; }
 
     size_t getCurrentNoteCount() const
     {
@@ -35,6 +79,15 @@ public:
     {
         return noteManager_.getKeyOnStateForDisp();
     }
+
+    // 出力側 (エンコード後) の記録は呼び出し側で blockEncoded する
+    sys::LatencyProbe& getLatencyProbe() { return latencyProbe_; }
+
+protected:
+    // 響板に入れる前まで、無音で響板も止まっていれば false
+    bool render(Note::SampleT* samples,
+                size_t nSamples,
+                io::MidiMessageQueue& midiIn);
 };
 
 } // namespace physical_modeling_piano
@@ -0,0 +1,149 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 0:52:40
+ */
+
+#include "real_fft.h"
+#include <assert.h>
+#include <math.h>
+
+namespace physical_modeling_piano
+{
+
+void
+RealFFT::initialize(size_t n)
+{
+    assert(n >= 4 && (n & (n - 1)) == 0);
+    n_ = n;
+
+    const size_t m = n / 2;
+    cos_.resize(m);
+    sin_.resize(m);
+    for (size_t k = 0; k < m; ++k)
+    {
+        double t = 2 * M_PI * k / n;
+        cos_[k]  = cos(t);
+        sin_[k]  = sin(t);
+    }
+
+    int bits = 0;
+    while ((size_t(1) << bits) < m)
+    {
+        ++bits;
+    }
+    bitReverse_.resize(m);
+    for (size_t i = 0; i < m; ++i)
+    {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; ++b)
+        {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        bitReverse_[i] = r;
+    }
+
+    workRe_.resize(m);
+    workIm_.resize(m);
+}
+
+// 時間間引きの基数 2、回転因子 e^{-2πik/m} は表を 2k おきに引く
+void
+RealFFT::transform(float* re, float* im) const
+{
+    const size_t m = n_ / 2;
+    for (size_t len = 2; len <= m; len <<= 1)
+    {
+        const size_t half   = len / 2;
+        const size_t stride = n_ / len;
+        for (size_t i = 0; i < m; i += len)
+        {
+            float* ar = re + i;
+            float* ai = im + i;
+            float* br = ar + half;
+            float* bi = ai + half;
+            for (size_t j = 0; j < half; ++j)
+            {
+                float wr = cos_[j * stride];
+                float wi = -sin_[j * stride];
+                float vr = br[j] * wr - bi[j] * wi;
+                float vi = br[j] * wi + bi[j] * wr;
+                br[j]    = ar[j] - vr;
+                bi[j]    = ai[j] - vi;
+                ar[j] += vr;
+                ai[j] += vi;
+            }
+        }
+    }
+}
+
+void
+RealFFT::forward(float* re, float* im, const float* in)
+{
+    const size_t m = n_ / 2;
+    for (size_t i = 0; i < m; ++i)
+    {
+        auto r     = bitReverse_[i];
+        workRe_[i] = in[r * 2];
+        workIm_[i] = in[r * 2 + 1];
+    }
+    transform(workRe_.data(), workIm_.data());
+
+    // Z[k] = E[k] + iO[k] から X[k] = E[k] + W^k O[k]
+    re[0] = workRe_[0] + workIm_[0];
+    im[0] = 0;
+    re[m] = workRe_[0] - workIm_[0];
+    im[m] = 0;
+    for (size_t k = 1; k < m; ++k)
+    {
+        float zr  = workRe_[k];
+        float zi  = workIm_[k];
+        float cr  = workRe_[m - k];  // conj(Z[m-k])
+        float ci  = -workIm_[m - k];
+        float er  = (zr + cr) * 0.5f;
+        float ei  = (zi + ci) * 0.5f;
+        float or_ = (zi - ci) * 0.5f; // (Z - conj) / 2i
+        float oi  = -(zr - cr) * 0.5f;
+        float wr  = cos_[k];
+        float wi  = -sin_[k];
+        re[k]     = er + or_ * wr - oi * wi;
+        im[k]     = ei + or_ * wi + oi * wr;
+    }
+}
+
+void
+RealFFT::inverse(float* out, const float* re, const float* im)
+{
+    const size_t m = n_ / 2;
+
+    // X[k] から Z[k] = E[k] + iO[k] を作り、ビット反転して詰める
+    // 逆変換は実部と虚部を入れ替えた順変換
+    const float scale = 1.0f / m;
+    for (size_t k = 0; k < m; ++k)
+    {
+        float xr  = re[k];
+        float xi  = im[k];
+        float cr  = re[m - k]; // conj(X[m-k])
+        float ci  = -im[m - k];
+        float er  = (xr + cr) * 0.5f;
+        float ei  = (xi + ci) * 0.5f;
+        float dr  = (xr - cr) * 0.5f; // W^k O[k]
+        float di  = (xi - ci) * 0.5f;
+        float wr  = cos_[k];          // conj(W^k)
+        float wi  = sin_[k];
+        float or_ = dr * wr - di * wi;
+        float oi  = dr * wi + di * wr;
+
+        auto r     = bitReverse_[k];
+        workRe_[r] = (ei + or_) * scale;
+        workIm_[r] = (er - oi) * scale;
+    }
+    transform(workRe_.data(), workIm_.data());
+
+    for (size_t i = 0; i < m; ++i)
+    {
+        out[i * 2]     = workIm_[i];
+        out[i * 2 + 1] = workRe_[i];
+    }
+}
+
+} // namespace physical_modeling_piano
@@ -0,0 +1,43 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 0:41:12
+ */
+#ifndef _61F0A3D2_5134_1E4F_0B7C_9D2E85A4C3F1
+#define _61F0A3D2_5134_1E4F_0B7C_9D2E85A4C3F1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace physical_modeling_piano
+{
+
+// 実数 n 点 (2^k) の FFT
+// n/2 点の複素 FFT に偶数番と奇数番を実部と虚部として詰めて計算する
+// スペクトルは実部と虚部を分けた n/2+1 点
+class RealFFT
+{
+    size_t n_{};
+    std::vector<float> cos_; // cos(2πk/n), k < n/2
+    std::vector<float> sin_; // sin(2πk/n)
+    std::vector<uint32_t> bitReverse_;
+    std::vector<float> workRe_;
+    std::vector<float> workIm_;
+
+public:
+    void initialize(size_t n);
+    size_t getSize() const { return n_; }
+
+    // in: n 点 -> re, im: n/2+1 点
+    void forward(float* re, float* im, const float* in);
+    // re, im: n/2+1 点 -> out: n 点 (forward の逆、1/n 倍込み)
+    void inverse(float* out, const float* re, const float* im);
+
+protected:
+    // ビット反転の順に並べた re, im を n/2 点の複素 FFT で置き換える
+    void transform(float* re, float* im) const;
+};
+
+} // namespace physical_modeling_piano
+
+#endif /* _61F0A3D2_5134_1E4F_0B7C_9D2E85A4C3F1 */
@@ -4,6 +4,7 @@
  */
 
 #include "soundboard.h"
+#include <algorithm>
 #include <assert.h>
 
 namespace physical_modeling_piano
@@ -11,29 +12,61 @@ namespace physical_modeling_piano
 
 namespace
 {
+// 遅延長は昇順
 constexpr size_t
-getDelayLength(int i)
+getDelayLength(int n, int i, uint32_t fs)
 {
-    constexpr size_t delayLengths[] = {37, 87, 181, 271, 359, 592, 687, 721};
-    return convertSampleSize(delayLengths[i]);
+    constexpr size_t delayLengths4[]  = {37, 181, 359, 687};
+    constexpr size_t delayLengths8[]  = {37, 87, 181, 271, 359, 592, 687, 721};
+    constexpr size_t delayLengths16[] = {37,
+                                         61,
+                                         87,
+                                         131,
+                                         181,
+                                         223,
+                                         271,
+                                         311,
+                                         359,
+                                         467,
+                                         592,
+                                         641,
+                                         687,
+                                         701,
+                                         721,
+                                         787};
+    return convertSampleSize(n == 4   ? delayLengths4[i]
+                             : n == 8 ? delayLengths8[i]
+                                      : delayLengths16[i],
+                             fs);
 }
 
 } // namespace
 
+template <int N, template <int> class Mixer>
 void
-Soundboard::initialize(const SystemParameters& sysParams)
+BasicSoundboard<N, Mixer>::initialize(const SystemParameters& sysParams)
 {
-    a_ = sysParams.soundboardFeedback;
+    mixer_.initialize(sysParams);
+
+    sampleRate_     = sysParams.sampleRate;
+    maxSpan_        = getDelayLength(N, 0, sampleRate_);
+    maxDelayLength_ = getDelayLength(N, N - 1, sampleRate_);
+    spanFunc_       = selectSpanFunc(sysParams.sampleRateIndex,
+                               std::make_index_sequence<N_SAMPLE_RATES>());
 
     size_t delaySize = 0;
 
-    for (int i = 0; i < 8; ++i)
+    for (int i = 0; i < N; ++i)
     {
-        auto delay = getDelayLength(i);
-        decay_[i].constant.initialize(sysParams.sampleRate / delay,
-                                      sysParams.sampleRate,
-                                      sysParams.soundboardLossC1,
-                                      sysParams.soundboardLossC3);
+        auto delay = getDelayLength(N, i, sampleRate_);
+        LossFilter<CoefT, FilterHistoryT> f;
+        f.initialize(sysParams.sampleRate / delay,
+                     sysParams.sampleRate,
+                     sysParams.soundboardLossC1,
+                     sysParams.soundboardLossC3);
+        decayB0_[i]  = f.getB0();
+        decayMA1_[i] = f.getMA1();
+        decayH_[i]   = 0;
 
         delaySize += computeDelayBufferSize(delay);
     }
@@ -42,64 +75,180 @@ Soundboard::initialize(const SystemParameters& sysParams)
     delayBuffer_.resize(delaySize);
 
     size_t ofs = 0;
-    for (int i = 0; i < 8; ++i)
+    for (int i = 0; i < N; ++i)
     {
-        auto delay = getDelayLength(i);
+        auto delay = getDelayLength(N, i, sampleRate_);
         auto size  = computeDelayBufferSize(delay);
         delays_[i].attachBuffer(&delayBuffer_[ofs], size);
         ofs += size;
     }
     assert(ofs == delayBuffer_.size());
+
+    spanWork_.assign(N * getMaxSpan(), 0);
+    spanOut_.assign(getMaxSpan(), 0);
+    clear();
+}
+
+template <int N, template <int> class Mixer>
+void
+BasicSoundboard<N, Mixer>::setScale(float s)
+{
+    scale_ = s / N;
+
+    // 出力は各遅延線の出力 (減衰フィルタの利得は 1 以下) の和に s/N を掛けたもの
+    silentMask_ = getAbsMask(ValueT(0.5f / 32768 / s));
+}
+
+template <int N, template <int> class Mixer>
+void
+BasicSoundboard<N, Mixer>::clear()
+{
+    std::fill(delayBuffer_.begin(), delayBuffer_.end(), 0);
+    std::fill(std::begin(o_), std::end(o_), 0);
+    std::fill(std::begin(decayH_), std::end(decayH_), 0);
+    mixer_.clear();
+    quietSamples_ = maxDelayLength_;
+}
+
+template <int N, template <int> class Mixer>
+template <size_t... I>
+typename BasicSoundboard<N, Mixer>::SpanFunc
+BasicSoundboard<N, Mixer>::selectSpanFunc(int rateIndex,
+                                          std::index_sequence<I...>)
+{
+    static constexpr SpanFunc table[] = {
+        &BasicSoundboard::updateSpan<SAMPLE_RATES[I]>...};
+    assert(rateIndex >= 0 && rateIndex < int(sizeof...(I)));
+    return table[rateIndex];
+}
+
+template <int N, template <int> class Mixer>
+void
+BasicSoundboard<N, Mixer>::updateQuiet(uint32_t mask, size_t n)
+{
+    quietSamples_ = mask <= silentMask_ ? quietSamples_ + n : 0;
+}
+
+template <int N, template <int> class Mixer>
+inline typename BasicSoundboard<N, Mixer>::ValueT
+BasicSoundboard<N, Mixer>::decay(int i, const ValueT& in)
+{
+    ValueT out;
+    maddWide(out, decayH_[i], decayB0_[i], in);
+    mul(decayH_[i], decayMA1_[i], out);
+    return out;
+}
+
+template <int N, template <int> class Mixer>
+void
+BasicSoundboard<N, Mixer>::update(ResultT* dst,
+                                  const ValueT* src,
+                                  size_t nSamples)
+{
+    while (nSamples)
+    {
+        auto n = std::min(nSamples, maxSpan_);
+        (this->*spanFunc_)(dst, src, n);
+        dst += n;
+        src += n;
+        nSamples -= n;
+    }
 }
 
+template <int N, template <int> class Mixer>
 void
-Soundboard::setScale(float s)
+BasicSoundboard<N, Mixer>::update(OutputSink& sink,
+                                  const ValueT* src,
+                                  size_t nSamples)
 {
-    scale_ = s / 8.0f;
+    static_assert(sizeof(ResultT) == sizeof(int32_t), "");
+
+    auto* out = spanOut_.data();
+    while (nSamples)
+    {
+        auto n = std::min(nSamples, maxSpan_);
+        (this->*spanFunc_)(out, src, n);
+        sink.write(reinterpret_cast<const int32_t*>(out), n);
+        src += n;
+        nSamples -= n;
+    }
+}
+
+template <int N, template <int> class Mixer>
+template <uint32_t FS>
+void
+BasicSoundboard<N, Mixer>::updateSpan(ResultT* dst,
+                                      const ValueT* src,
+                                      size_t n)
+{
+    constexpr size_t MAX_SPAN = getDelayLength(N, 0, FS);
+    assert(n <= MAX_SPAN);
+
+    // 読む位置は全て書く位置より前なので、先に span 分をまとめて読む
+    // 遅延線に書く値も読み終わった所に作る
+    auto* x = spanWork_.data();
+    for (int k = 0; k < N; ++k)
+    {
+        delays_[k].read(x + k * MAX_SPAN, n, getDelayLength(N, k, FS));
+    }
+
+    // 状態はレーンごとに並べてローカルに持つ
+    ValueT o[N];
+    FilterHistoryT h[N];
+    std::copy(o_, o_ + N, o);
+    std::copy(decayH_, decayH_ + N, h);
+    auto mixer    = mixer_;
+    uint32_t mask = 0;
+
+    for (size_t j = 0; j < n; ++j)
+    {
+        ValueT in[N];
+        mixer.feedback(in, o, src[j]);
+
+        for (int k = 0; k < N; ++k)
+        {
+            auto& xk = x[k * MAX_SPAN + j];
+            maddWide(o[k], h[k], decayB0_[k], xk);
+            mul(h[k], decayMA1_[k], o[k]);
+            xk = in[k];
+            addAbsMask(mask, in[k]);
+        }
+
+        mul(dst[j], mixer.output(o), scale_);
+    }
+
+    std::copy(o, o + N, o_);
+    std::copy(h, h + N, decayH_);
+    mixer_ = mixer;
+    updateQuiet(mask, n);
+
+    for (int k = 0; k < N; ++k)
+    {
+        delays_[k].write(x + k * MAX_SPAN, n);
+    }
 }
 
+template <int N, template <int> class Mixer>
 void
-Soundboard::update(ResultT* dst, const ValueT* src, size_t nSamples)
+BasicSoundboard<N, Mixer>::updateSerial(ResultT* dst,
+                                        const ValueT* src,
+                                        size_t nSamples)
 {
     while (nSamples)
     {
-        ValueT t;
-        mul(t, ot_, a_);
-        add(t, t, *src);
-
-        ValueT i[8];
-        add(i[0], t, o_[1]);
-        add(i[1], t, o_[2]);
-        add(i[2], t, o_[3]);
-        add(i[3], t, o_[4]);
-        add(i[4], t, o_[5]);
-        add(i[5], t, o_[6]);
-        add(i[6], t, o_[7]);
-        add(i[7], t, o_[0]);
-
-        o_[0] = decay_[0].filter(delays_[0].update(i[0], getDelayLength(0)));
-        o_[1] = decay_[1].filter(delays_[1].update(i[1], getDelayLength(1)));
-        o_[2] = decay_[2].filter(delays_[2].update(i[2], getDelayLength(2)));
-        o_[3] = decay_[3].filter(delays_[3].update(i[3], getDelayLength(3)));
-        o_[4] = decay_[4].filter(delays_[4].update(i[4], getDelayLength(4)));
-        o_[5] = decay_[5].filter(delays_[5].update(i[5], getDelayLength(5)));
-        o_[6] = decay_[6].filter(delays_[6].update(i[6], getDelayLength(6)));
-        o_[7] = decay_[7].filter(delays_[7].update(i[7], getDelayLength(7)));
-
-        ValueT oo, oe;
-        add(oe, o_[0], o_[2]);
-        add(oe, oe, o_[4]);
-        add(oe, oe, o_[6]);
-        add(oo, o_[1], o_[3]);
-        add(oo, oo, o_[5]);
-        add(oo, oo, o_[7]);
-
-        ValueT r;
-        sub(r, oe, oo);
-        add(ot_, oe, oo);
-
-        ResultT rs;
-        mul(*dst, r, scale_);
+        ValueT i[N];
+        mixer_.feedback(i, o_, *src);
+
+        uint32_t mask = 0;
+        for (int k = 0; k < N; ++k)
+        {
+            o_[k] = decay(
+                k, delays_[k].update(i[k], getDelayLength(N, k, sampleRate_)));
+            addAbsMask(mask, i[k]);
+        }
+        updateQuiet(mask, 1);
+
+        mul(*dst, mixer_.output(o_), scale_);
 
         ++dst;
         ++src;
@@ -107,4 +256,11 @@ Soundboard::update(ResultT* dst, const ValueT* src, size_t nSamples)
     }
 }
 
+template class BasicSoundboard<4, SumDifferenceMixer>;
+template class BasicSoundboard<8, SumDifferenceMixer>;
+template class BasicSoundboard<16, SumDifferenceMixer>;
+template class BasicSoundboard<4, HadamardMixer>;
+template class BasicSoundboard<8, HadamardMixer>;
+template class BasicSoundboard<16, HadamardMixer>;
+
 } // namespace physical_modeling_piano
@@ -8,15 +8,18 @@
 #include "delay.h"
 #include "filter.h"
 #include "fixed.h"
+#include "output_sink.h"
 #include "sys_params.h"
+#include <math.h>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace physical_modeling_piano
 {
 
-class Soundboard
+struct SoundboardTypes
 {
-public:
 #if USE_FIXED_POINT
     using ValueT         = FixedPoint<int32_t, 25>;
     using FilterHistoryT = FixedPoint<int32_t, 33>;
@@ -30,27 +33,192 @@ public:
     using ResultT        = float;
     using ScaleT         = float;
 #endif
+};
+
+// 帰還行列
+// feedback: 1つ前の各遅延線の出力 o と入力 src から各遅延線へ書く値を作る
+// output:   今回の各遅延線の出力から外へ出す値を作る (1/N 倍する前)
+
+// in[k] = src + a * sum(o) + o[k+1], 出力は偶数番と奇数番の差
+// a = -2/N で巡回置換付きの Householder 行列になる
+template <int N>
+class SumDifferenceMixer : public SoundboardTypes
+{
+    CoefT a_{};
+    ValueT ot_{}; // sum(o)
+
+public:
+    void initialize(const SystemParameters& sysParams)
+    {
+        // soundboardFeedback は 8本のときの値
+        a_ = sysParams.soundboardFeedback * 8.0f / N;
+    }
+
+    void clear() { ot_ = 0; }
+
+    void feedback(ValueT* in, const ValueT* o, const ValueT& src) const
+    {
+        ValueT t;
+        mul(t, ot_, a_);
+        add(t, t, src);
+        for (int k = 0; k < N; ++k)
+        {
+            add(in[k], t, o[(k + 1) & (N - 1)]);
+        }
+    }
+
+    ValueT output(const ValueT* o)
+    {
+        ValueT oe = o[0];
+        ValueT oo = o[1];
+        for (int k = 2; k < N; k += 2)
+        {
+            add(oe, oe, o[k]);
+            add(oo, oo, o[k + 1]);
+        }
+
+        ValueT r;
+        sub(r, oe, oo);
+        add(ot_, oe, oo);
+        return r;
+    }
+};
+
+// in = src + H o / sqrt(N) (H: アダマール行列), 出力は偶数番と奇数番の差
+// 密な直交行列を高速アダマール変換の N log2(N) 回の加減算で作る
+template <int N>
+class HadamardMixer : public SoundboardTypes
+{
+    CoefT norm_{};
+
+public:
+    void initialize(const SystemParameters&)
+    {
+        // 係数の精度で切り捨てて 1 を超えないようにする (N=8)
+        norm_ = floorf(256 / sqrtf(N)) / 256;
+    }
+
+    void clear() {}
+
+    // 前半と後半をそれぞれ変換してから和と差をとる
+    template <int M>
+    static void transform(ValueT* v, std::integral_constant<int, M>)
+    {
+        using Half = std::integral_constant<int, M / 2>;
+        transform(v, Half());
+        transform(v + M / 2, Half());
+        for (int i = 0; i < M / 2; ++i)
+        {
+            auto a = v[i];
+            add(v[i], a, v[i + M / 2]);
+            sub(v[i + M / 2], a, v[i + M / 2]);
+        }
+    }
+    static void transform(ValueT*, std::integral_constant<int, 1>) {}
+
+    void feedback(ValueT* in, const ValueT* o, const ValueT& src) const
+    {
+        ValueT v[N];
+        std::copy(o, o + N, v);
+        transform(v, std::integral_constant<int, N>());
+        for (int k = 0; k < N; ++k)
+        {
+            ValueT t;
+            mul(t, v[k], norm_);
+            add(in[k], t, src);
+        }
+    }
+
+    ValueT output(const ValueT* o) const
+    {
+        ValueT r = o[0];
+        for (int k = 1; k < N; ++k)
+        {
+            if (k & 1)
+            {
+                sub(r, r, o[k]);
+            }
+            else
+            {
+                add(r, r, o[k]);
+            }
+        }
+        return r;
+    }
+};
+
+// N: 遅延線の数 (4, 8, 16)
+template <int N, template <int> class Mixer>
+class BasicSoundboard : public SoundboardTypes
+{
+    static_assert(N == 4 || N == 8 || N == 16, "");
 
 public:
-    Soundboard() { setScale(10.0f); }
+    BasicSoundboard() { setScale(10.0f); }
 
     void initialize(const SystemParameters& sysParams);
     void setScale(float s);
 
+    // 最短の遅延長ごとにまとめて処理する
     void update(ResultT* dst, const ValueT* src, size_t nSamples);
+    // 同じく、最短の遅延長ごとの出力をそのまま sink に渡す
+    void update(OutputSink& sink, const ValueT* src, size_t nSamples);
+    // 1サンプルずつ処理する (比較用、結果は update と同じ)
+    void updateSerial(ResultT* dst, const ValueT* src, size_t nSamples);
+
+    // この長さまでは遅延線の読み出しが書き込みに追い付かない
+    size_t getMaxSpan() const { return maxSpan_; }
+
+    // 最長の遅延長の間、遅延線に書いた値が全て出力の 1/2 LSB 未満
+    // これ以降は無音を入れ続ける限り update を呼ばなくてもよい
+    bool isSilent() const { return quietSamples_ >= maxDelayLength_; }
+    // 遅延線と状態を 0 にする
+    void clear();
+
+protected:
+    using SpanFunc = void (BasicSoundboard::*)(ResultT*, const ValueT*, size_t);
+
+    // 遅延長を定数にするためサンプリング周波数ごとに展開する
+    template <uint32_t FS>
+    void updateSpan(ResultT* dst, const ValueT* src, size_t n);
+    template <size_t... I>
+    static SpanFunc selectSpanFunc(int rateIndex, std::index_sequence<I...>);
+
+    ValueT decay(int i, const ValueT& in);
+    void updateQuiet(uint32_t mask, size_t n);
 
 private:
-    DelayState<ValueT> delays_[8];
+    uint32_t sampleRate_{};
+    size_t maxSpan_{};
+    size_t maxDelayLength_{};
+    SpanFunc spanFunc_{};
+
+    DelayState<ValueT> delays_[N];
     std::vector<ValueT> delayBuffer_;
 
-    ValueT o_[8]{};
-    ValueT ot_{};
-    CoefT a_{};
-    ScaleT scale_{}; // 1/8含む
+    Mixer<N> mixer_;
+    ValueT o_[N]{};
+    ScaleT scale_{}; // 1/N含む
+
+    uint32_t silentMask_{};  // 遅延線に書く値の絶対値がこれ以下なら無音
+    size_t quietSamples_{}; // 無音の値を書き続けたサンプル数
 
-    Filter<LossFilter<CoefT, FilterHistoryT>> decay_[8];
+    // 減衰フィルタ (LossFilter) の係数と状態をレーンごとに並べて持つ
+    CoefT decayB0_[N]{};
+    CoefT decayMA1_[N]{};
+    FilterHistoryT decayH_[N]{};
+
+    // update の作業領域 [レーン][サンプル] (音声タスクのスタックには大きい)
+    std::vector<ValueT> spanWork_;
+    std::vector<ResultT> spanOut_; // sink に渡す 1 span 分
 };
 
+#if SOUNDBOARD_HADAMARD
+using Soundboard = BasicSoundboard<SOUNDBOARD_DELAY_LINES, HadamardMixer>;
+#else
+using Soundboard = BasicSoundboard<SOUNDBOARD_DELAY_LINES, SumDifferenceMixer>;
+#endif
+
 } // namespace physical_modeling_piano
 
 #endif /* _4C189BD8_C134_1528_201F_B37AFEDA5067 */
@@ -0,0 +1,82 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Mon Oct 19 2026 0:12:37
+ */
+#ifndef _6E0F3B19_2134_1E2B_5A7C_94D2E81B3F60
+#define _6E0F3B19_2134_1E2B_5A7C_94D2E81B3F60
+
+#include <assert.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace physical_modeling_piano
+{
+
+// 1 対 1 のタスク間でロックなしに受け渡すリングバッファ
+// バッファは外部のもので、size 個の領域に size - 1 個まで入る
+// pop は CAS で進めるので、書き込み側が取り戻すのにも使える (T はコピーのみ)
+template <class T>
+class SPSCRing
+{
+    T* buffer_{};
+    uint32_t size_{};
+    std::atomic<uint32_t> head_{0}; // 読み出し側が進める
+    std::atomic<uint32_t> tail_{0}; // 書き込み側が進める
+
+public:
+    void attachBuffer(T* buffer, size_t size)
+    {
+        assert(size >= 2);
+        buffer_ = buffer;
+        size_   = size;
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+    bool push(const T& v)
+    {
+        auto t = tail_.load(std::memory_order_relaxed);
+        auto n = next(t);
+        if (n == head_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        buffer_[t] = v;
+        tail_.store(n, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T* v)
+    {
+        auto h = head_.load(std::memory_order_acquire);
+        while (h != tail_.load(std::memory_order_acquire))
+        {
+            T r = buffer_[h];
+            if (head_.compare_exchange_weak(h,
+                                            next(h),
+                                            std::memory_order_acq_rel,
+                                            std::memory_order_acquire))
+            {
+                *v = r;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool empty() const
+    {
+        return head_.load(std::memory_order_acquire) ==
+               tail_.load(std::memory_order_acquire);
+    }
+
+    static size_t computeBufferSize(size_t n) { return (n + 1) * sizeof(T); }
+
+protected:
+    uint32_t next(uint32_t i) const { return i + 1 == size_ ? 0 : i + 1; }
+};
+
+} // namespace physical_modeling_piano
+
+#endif /* _6E0F3B19_2134_1E2B_5A7C_94D2E81B3F60 */
@@ -6,6 +6,7 @@
 #include "string.h"
 #include "sys_params.h"
 #include <algorithm>
+#include <math.h>
 
 namespace physical_modeling_piano
 {
@@ -19,20 +20,22 @@ String::initialize(
     auto delay1 =
         std::max(1, (int)(sysParams.hammerPosition * 0.5f * delayTotal));
 
-    M_ = (f > 400) ? 1 : 4;
-    for (int i = 0; i < M_; ++i)
-    {
-        dispersion_[i].initialize(B, f, M_);
-    }
-    for (int i = M_; i < 4; ++i)
-    {
-        dispersion_[i].reset();
-    }
-    float dispersionDelay = M_ * dispersion_[0].computeGroupDelay(f, Fs);
+    const int M = (f > 400) ? 1 : 4;
+    dispersion_.initialize(B, f, M);
+    float dispersionDelay = dispersion_.computeGroupDelay(f, Fs);
 
     lowpass_.initialize(f, Fs, sysParams.stringLossC1, sysParams.stringLossC3);
     float lowpassDelay = lowpass_.computeGroupDelay(f, Fs);
 
+    // 4本の遅延線 (各 1 以上) と端数の遅延 (1 程度) に分散フィルタの遅延を
+    // 足すと周期を超える最高音域 (低いサンプリング周波数) では分散を諦める
+    // そこでは Nyquist までの倍音も 2, 3本しか無い
+    if (delayTotal < 4 + 1 + lowpassDelay + dispersionDelay)
+    {
+        dispersion_.initializeIdentity(M);
+        dispersionDelay = 0;
+    }
+
     int delay2 =
         std::max(1, (int)(0.5f * (delayTotal - 2 * delay1) - dispersionDelay));
     int delay3 =
@@ -45,8 +48,19 @@ String::initialize(
 
     auto D = delayTotal -
              (delay1 * 2 + delay2 + delay3 + dispersionDelay + lowpassDelay);
-    //    fracDelay_.initialize(D, (int)(D + 0.5f));
-    fracDelay_.initialize(D, std::max(1, (int)(D)));
+    if (sysParams.tuningFilter == TuningFilterType::ALLPASS1)
+    {
+        // 整数部は d1b に寄せて端数だけ 1次 allpass で処理する
+        int di = std::max(0, (int)(D - 0.5f));
+        delay3 += di;
+        D -= di;
+        fracDelay_.initializeFirstOrder(D, f, Fs);
+    }
+    else
+    {
+        //    fracDelay_.initialize(D, (int)(D + 0.5f));
+        fracDelay_.initialize(D, std::max(1, (int)(D)));
+    }
     float tuningDelay = fracDelay_.computeGroupDelay(f, Fs);
     (void)tuningDelay;
 
@@ -71,8 +85,51 @@ String::initialize(
     d1a_.initialize(delay2);
     d1b_.initialize(delay3);
 
+    // 端数の遅延は低域での遅延 (allpass1 では f での端数分だけ) で決めたので、
+    // 周期が短いと分散フィルタなども含めたループの f での位相遅延とずれる
+    // 次数はそのままで D を直してループ全体を周期に合わせる
+    // 位相遅延の D に対する傾きは 1 より小さいので割線法で、
+    // 高次では位相の計算の誤差 (1e-3 程度) があるので一番良かったものにする
+    const int order  = fracDelay_.getDim();
+    auto setFraction = [&](float d) {
+        if (sysParams.tuningFilter == TuningFilterType::ALLPASS1)
+        {
+            fracDelay_.initializeFirstOrder(d, f, Fs);
+        }
+        else
+        {
+            // D > order - 1 でないと不安定になる
+            fracDelay_.initialize(std::max(d, order - 0.5f), order);
+        }
+    };
+    float d0    = D;
+    float e0    = delayTotal - computeLoopDelay(f, Fs);
+    float bestD = d0;
+    float bestE = e0;
+    float d1    = D + e0;
+    for (int i = 0; i < 8 && fabsf(bestE) > 1e-3f; ++i)
+    {
+        setFraction(d1);
+        float e1 = delayTotal - computeLoopDelay(f, Fs);
+        if (fabsf(e1) < fabsf(bestE))
+        {
+            bestD = d1;
+            bestE = e1;
+        }
+        if (e1 == e0)
+        {
+            break;
+        }
+        float d = d1 - e1 * (d1 - d0) / (e1 - e0);
+        d0      = d1;
+        e0      = e1;
+        d1      = d;
+    }
+    setFraction(bestD);
+
     float alpha12 = 2 * Z / (Z + Zb);
     alpha12_      = alpha12;
+
     // printf("Z:%f Zb:%f alpha12:%f, %f, %d\n",
     //        Z,
     //        Zb,
@@ -83,6 +140,48 @@ String::initialize(
 
 String::State::State() {}
 
+void
+String::setFracDelayOrder(int n)
+{
+    // 係数を 0 で延長するだけなので特性は変わらない
+    assert(n >= getFracDelayOrder());
+    fracDelay_.setDim(n);
+}
+
+float
+String::computeLoopDelay(float f, float Fs) const
+{
+    float d = d0a_.getDelay() + d0b_.getDelay() + d1a_.getDelay() +
+              d1b_.getDelay();
+    d += dispersion_.computePhaseDelay(f, Fs);
+    d += lowpass_.computePhaseDelay(f, Fs);
+    d += fracDelay_.computePhaseDelay(f, Fs);
+    return d;
+}
+
+int
+String::computeStorageHeadroomBits(float f)
+{
+    // 500Hz より上では 1oct あたり 0.75bit 程度ピークが下がる
+    return (int)(std::max(0.0f, log2f(f / 500)) * 0.75f);
+}
+
+int
+String::computeDelayStorageShift(float v, int headroomBits)
+{
+#if USE_COMPRESSED_DELAY_BUFFER
+    // 遅延線の値のピークは打鍵の強さにほぼ比例して raw 値で v * 2^20 程度
+    // 弱打では低音の方が相対的に大きくなるので下限を設けて余裕を持たせる
+    float peak = std::max(v, 0.6f) * (1 << 20) * 1.5f;
+    int bits   = 32 - __builtin_clz(static_cast<uint32_t>(peak));
+    return std::max(0, bits - 15 - headroomBits);
+#else
+    (void)v;
+    (void)headroomBits;
+    return 0;
+#endif
+}
+
 size_t
 String::getStateSize() const
 {
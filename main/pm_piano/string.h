@@ -12,6 +12,7 @@
 #include "sys_params.h"
 #include <algorithm>
 #include <array>
+#include <type_traits>
 
 namespace physical_modeling_piano
 {
@@ -19,12 +20,15 @@ namespace physical_modeling_piano
 class String
 {
 public:
+    static constexpr int MAX_FRAC_DELAY_ORDER = 7;
+    static constexpr int MAX_DISPERSION_STAGES = 4;
+
 #if USE_FIXED_POINT
     using BridgeSampleT   = FixedPoint<int32_t, 25>;
     using StringSampleT   = FixedPoint<int32_t, 20>;
-    using FilterSampleT   = FixedPoint<int32_t, 15>;
+    using FilterSampleT   = FixedPoint<int32_t, 14>;
     using FilterConstT    = FixedPoint<int16_t, 12>;
-    using FilterHistoryT  = FixedPoint<int32_t, 27>; // String * FilterConst
+    using FilterHistoryT  = FixedPoint<int32_t, 26>; // Sample * FilterConst
     using ImpedanceRatioT = FixedPoint<int32_t, 14>;
     using HammerLoadT     = StringSampleT;
     using SampleT         = BridgeSampleT;
@@ -32,6 +36,8 @@ public:
     // StringSampleは 2^27 くらいの値
     // ImpedanceRatioは 2^-10 くらいの値
     // 27+(14-10)=31
+    // FilterConst (~1.9) * FilterSample (~9.6) が 16 を超えるので
+    // FilterHistory は ±32 まで入る Q26 にする
 #else
     using BridgeSampleT   = float;
     using StringSampleT   = float;
@@ -43,22 +49,33 @@ public:
     using SampleT         = float;
 #endif
 
-    using ThirianDispersionFilterT =
-        ThirianDispersionFilter<FilterConstT, FilterHistoryT>;
+    using DispersionFilterT = ThirianDispersionCascade<MAX_DISPERSION_STAGES,
+                                                       FilterConstT,
+                                                       FilterHistoryT>;
 
     using LossFilterT = LossFilter<FilterConstT, FilterHistoryT>;
 
-    using ThirianFilterT =
-        ThirianFilter<7, FilterConstT, FilterHistoryT, FilterSampleT>;
+    using ThirianFilterT = ThirianFilter<MAX_FRAC_DELAY_ORDER,
+                                         FilterConstT,
+                                         FilterHistoryT,
+                                         FilterSampleT>;
 
     class DelayNode
     {
     public:
+#if USE_COMPRESSED_DELAY_BUFFER
+        using DelayStateT = CompressedDelayState<StringSampleT>;
+#elif USE_EXACT_DELAY_BUFFER
+        using DelayStateT = ExactDelayState<StringSampleT>;
+#else
+        using DelayStateT = DelayState<StringSampleT>;
+#endif
+
         struct State
         {
             StringSampleT in{}; // 更新タイミングでdelayに入れてしまえば不要
             StringSampleT out{};
-            DelayState<StringSampleT> delay;
+            DelayStateT delay;
 
         public:
             const StringSampleT& getOut() const { return out; }
@@ -68,31 +85,58 @@ public:
     public:
         void initialize(int d)
         {
-            delay_           = std::max(0, d - 1);
-            delayBufferSize_ = computeDelayBufferSize(delay_);
-            //            printf("d = %d/%d\n", delay_, delayBufferSize_);
-            assert(delay_ <= delayBufferSize_);
+            delay_ = std::max(0, d - 1);
+            //            printf("d = %d/%d\n", delay_, getBufferSize());
+            assert(delay_ <= getBufferSize());
         }
         void update(State& s) const { s.out = s.delay.update(s.in, delay_); }
+        int getDelay() const { return delay_ + 1; }
 
-        void reset(State& s, SimpleLinearAllocator& allocator) const
+        // バッファの大きさはキーオン時にしか要らないので遅延長から求める
+        size_t getBufferSize() const
         {
-            s.in  = 0;
-            s.out = 0;
-            s.delay.attachBuffer(static_cast<StringSampleT*>(allocator.allocate(
-                                     delayBufferSize_ * sizeof(StringSampleT))),
-                                 delayBufferSize_);
-            s.delay.clear(delay_);
+#if USE_EXACT_DELAY_BUFFER
+            return computeExactDelayBufferSize(delay_);
+#else
+            return computeDelayBufferSize(delay_);
+#endif
+        }
+
+        void reset(State& s,
+                   SimpleLinearAllocator& allocator,
+                   int storageShift,
+                   bool zeroFill) const
+        {
+            using StorageT = DelayStateT::StorageT;
+
+            auto size = getBufferSize();
+            s.in      = 0;
+            s.out     = 0;
+            s.delay.attachBuffer(
+                static_cast<StorageT*>(allocator.allocate(
+                    size * sizeof(StorageT), alignof(StorageT))),
+                size);
+            s.delay.clear(delay_, zeroFill);
+#if USE_COMPRESSED_DELAY_BUFFER
+            s.delay.setShift(storageShift);
+#else
+            (void)storageShift;
+#endif
         }
 
         inline size_t getStateSize() const
         {
-            return delayBufferSize_ * sizeof(StringSampleT);
+            return getBufferSize() * sizeof(DelayStateT::StorageT);
+        }
+
+        template <class Archive>
+        void serializeCoefficients(Archive& ar)
+        {
+            ar(delay_);
         }
 
     private:
         uint16_t delay_{};
-        uint16_t delayBufferSize_{};
     };
 
     struct State
@@ -102,7 +146,7 @@ public:
         DelayNode::State d1a;
         DelayNode::State d1b;
 
-        ThirianDispersionFilterT::State dispersion[4];
+        DispersionFilterT::State dispersion;
         LossFilterT::State lowpass;
         ThirianFilterT::State fracDelay;
 
@@ -115,14 +159,67 @@ public:
 
     size_t getStateSize() const;
 
-    void reset(State& s, SimpleLinearAllocator& allocator) const
+    int getFracDelayOrder() const { return fracDelay_.getDim(); }
+    void setFracDelayOrder(int n);
+    int getDispersionStages() const { return dispersion_.getStages(); }
+
+    // 各遅延線で DelayState が保持する遅延長 [sample]
+    std::array<int, 4> getDelayLengths() const
+    {
+        return {{d0a_.getDelay() - 1,
+                 d0b_.getDelay() - 1,
+                 d1a_.getDelay() - 1,
+                 d1b_.getDelay() - 1}};
+    }
+
+    // f でのループ全体の位相遅延 [sample]
+    float computeLoopDelay(float f, float Fs) const;
+
+    // f の弦の遅延線の値がピークからどれだけ小さいか [bit]
+    // 描画には使わないので Note 側に持つ
+    static int computeStorageHeadroomBits(float f);
+    // 打鍵の強さ v と上の headroomBits から決めた遅延線の格納スケール
+    static int computeDelayStorageShift(float v, int headroomBits);
+
+    // 係数の保存と復元 (note_table)
+    template <class Archive>
+    void serializeCoefficients(Archive& ar)
     {
-        d0a_.reset(s.d0a, allocator);
-        d0b_.reset(s.d0b, allocator);
-        d1a_.reset(s.d1a, allocator);
-        d1b_.reset(s.d1b, allocator);
+        d0a_.serializeCoefficients(ar);
+        d0b_.serializeCoefficients(ar);
+        d1a_.serializeCoefficients(ar);
+        d1b_.serializeCoefficients(ar);
+        ar(alpha12_);
+        dispersion_.serializeCoefficients(ar);
+        lowpass_.serializeCoefficients(ar);
+        fracDelay_.serializeCoefficients(ar);
+    }
 
-        dispersion_[0].clear(s.dispersion[0]);
+    // 今の状態のまま storageShift で打ち直せるか
+    // 遅延線の格納スケールが足りない場合は reset し直す必要がある
+    bool canRestrike(const State& s, int storageShift) const
+    {
+#if USE_COMPRESSED_DELAY_BUFFER
+        return storageShift <= s.d0a.delay.getShift();
+#else
+        (void)s;
+        (void)storageShift;
+        return true;
+#endif
+    }
+
+    // zeroFill が false なら allocator のメモリは既に 0 になっているものとする
+    void reset(State& s,
+               SimpleLinearAllocator& allocator,
+               int storageShift,
+               bool zeroFill = true) const
+    {
+        d0a_.reset(s.d0a, allocator, storageShift, zeroFill);
+        d0b_.reset(s.d0b, allocator, storageShift, zeroFill);
+        d1a_.reset(s.d1a, allocator, storageShift, zeroFill);
+        d1b_.reset(s.d1b, allocator, storageShift, zeroFill);
+
+        dispersion_.clear(s.dispersion);
         lowpass_.clear(s.lowpass);
         fracDelay_.clear(s.fracDelay);
     }
@@ -146,6 +243,8 @@ public:
         d1b_.update(s.d1b);
     }
 
+    // FRAC_ORDER, M が 0 の場合は実行時の次数で処理する
+    template <int FRAC_ORDER = 0, int M = 0>
     inline SampleT
     update(State& s, BridgeSampleT bridgeLoad, HammerLoadT hammerLoad) const
     {
@@ -170,11 +269,11 @@ public:
 
         StringSampleT tmp1b;
         sub(tmp1b, loadH, s.d1a.getOut());
-        s.d1b.setIn(filterH(tmp1b, s));
+        s.d1b.setIn(filterH<M>(tmp1b, s));
 
         StringSampleT tmp1a;
         sub(tmp1a, loadB1, s.d1b.getOut());
-        s.d1a.setIn(filterB(tmp1a, s));
+        s.d1a.setIn(filterB<FRAC_ORDER>(tmp1a, s));
 #if 0
         printf("bl %f, hl %f, lh %f, lb %f, lb1 %f,  d0b %f, d0a %f, d1a %f, "
                "d1b %f\n",
@@ -192,22 +291,53 @@ public:
     }
 
 protected:
+    template <int M>
     FilterSampleT filterH(FilterSampleT y, State& s) const
     {
-        y = dispersion_[0].filter(y, s.dispersion[0]);
-        y = dispersion_[1].filter(y, s.dispersion[1]);
-        y = dispersion_[2].filter(y, s.dispersion[2]);
-        y = dispersion_[3].filter(y, s.dispersion[3]);
-        return y;
+        static_assert(M <= MAX_DISPERSION_STAGES, "");
+        return filterDispersion(y, s, std::integral_constant<int, M>());
+    }
+
+    template <int M>
+    FilterSampleT filterDispersion(FilterSampleT y,
+                                   State& s,
+                                   std::integral_constant<int, M>) const
+    {
+        return dispersion_.template filter<M>(y, s.dispersion);
     }
 
+    FilterSampleT filterDispersion(FilterSampleT y,
+                                   State& s,
+                                   std::integral_constant<int, 0>) const
+    {
+        return dispersion_.filter(y, s.dispersion);
+    }
+
+    template <int FRAC_ORDER>
     FilterSampleT filterB(FilterSampleT y, State& s) const
     {
+        static_assert(FRAC_ORDER <= MAX_FRAC_DELAY_ORDER, "");
         y = lowpass_.filter(y, s.lowpass);
-        y = fracDelay_.filter(y, s.fracDelay);
+        y = filterFracDelay(
+            y, s, std::integral_constant<int, FRAC_ORDER>());
         return y;
     }
 
+    template <int FRAC_ORDER>
+    FilterSampleT filterFracDelay(FilterSampleT y,
+                                  State& s,
+                                  std::integral_constant<int, FRAC_ORDER>) const
+    {
+        return fracDelay_.template filter<FRAC_ORDER>(y, s.fracDelay);
+    }
+
+    FilterSampleT filterFracDelay(FilterSampleT y,
+                                  State& s,
+                                  std::integral_constant<int, 0>) const
+    {
+        return fracDelay_.filter(y, s.fracDelay);
+    }
+
 private:
     DelayNode d0a_;
     DelayNode d0b_;
@@ -220,8 +350,7 @@ private:
     // |<-D0a<-|H|<-D1a<-|B|<-0
     // |->D0b->| |->D1b->| |->out
 
-    int M_ = 0;
-    ThirianDispersionFilterT dispersion_[4];
+    DispersionFilterT dispersion_;
     LossFilterT lowpass_;
     ThirianFilterT fracDelay_;
 };
@@ -0,0 +1,31 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sun Oct 18 2026 20:18:4
+ */
+
+#include "sys_params.h"
+
+namespace physical_modeling_piano
+{
+
+static_assert(sizeof(SAMPLE_RATES) / sizeof(SAMPLE_RATES[0]) == N_SAMPLE_RATES,
+              "");
+
+bool
+SystemParameters::setSampleRate(uint32_t fs)
+{
+    int i = findSampleRate(fs);
+    if (i < 0)
+    {
+        return false;
+    }
+
+    sampleRate      = fs;
+    sampleRateIndex = i;
+    deltaT          = 1.0f / fs;
+    deltaTF         = 1.0f / fs;
+    deltaT_2F       = 0.5f / fs;
+    return true;
+}
+
+} // namespace physical_modeling_piano
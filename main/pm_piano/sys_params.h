@@ -6,13 +6,71 @@
 #define _4438B837_7134_14C6_141F_F1B7870F56FE
 
 #include "fixed.h"
+#include <stddef.h>
 #include <stdint.h>
 
 #define USE_FIXED_POINT 1
 
+// 弦の遅延線を 2^n に切り上げず遅延長ちょうどで確保する
+#ifndef USE_EXACT_DELAY_BUFFER
+#define USE_EXACT_DELAY_BUFFER 1
+#endif
+
+// 弦の遅延線の中身を打鍵の強さで決めたスケールの int16 で持つ
+#ifndef USE_COMPRESSED_DELAY_BUFFER
+#define USE_COMPRESSED_DELAY_BUFFER 0
+#endif
+
+#if USE_COMPRESSED_DELAY_BUFFER && !(USE_FIXED_POINT && USE_EXACT_DELAY_BUFFER)
+#error "compressed delay needs USE_FIXED_POINT and USE_EXACT_DELAY_BUFFER"
+#endif
+
+// soundboard の遅延線の数 (4, 8, 16)
+#ifndef SOUNDBOARD_DELAY_LINES
+#define SOUNDBOARD_DELAY_LINES 8
+#endif
+
+// soundboard の帰還行列を和と差 (Householder) からアダマールにする
+#ifndef SOUNDBOARD_HADAMARD
+#define SOUNDBOARD_HADAMARD 0
+#endif
+
+// Piano の響板を FDN からインパルス応答の畳み込みにする (host 用)
+#ifndef SOUNDBOARD_CONVOLUTION
+#define SOUNDBOARD_CONVOLUTION 0
+#endif
+
 namespace physical_modeling_piano
 {
 
+// 選べるサンプリング周波数 [Hz]
+// 響板の処理はこれらそれぞれに遅延長を定数にしたものを持つ
+constexpr uint32_t SAMPLE_RATES[]      = {22050, 32000, 44100, 48000};
+constexpr int N_SAMPLE_RATES           = 4;
+constexpr uint32_t DEFAULT_SAMPLE_RATE = 32000;
+
+// SAMPLE_RATES の中の位置、無ければ -1
+constexpr int
+findSampleRate(uint32_t fs, int i = 0)
+{
+    return i == N_SAMPLE_RATES       ? -1
+           : SAMPLE_RATES[i] == fs ? i
+                                   : findSampleRate(fs, i + 1);
+}
+
+// 44.1kHz で決めた長さ (サンプル数) を fs のものに直す
+constexpr size_t
+convertSampleSize(size_t s, uint32_t fs)
+{
+    return s * fs / 44100;
+}
+
+enum class TuningFilterType
+{
+    THIRIAN,  // 端数遅延全体を高次 Thirian で
+    ALLPASS1, // 整数部は遅延線に寄せて 1次 allpass で
+};
+
 struct SystemParameters
 {
     float youngsModulus      = 200e9f;  // [Pa]
@@ -27,26 +85,24 @@ struct SystemParameters
 
     float tune[3] = {1, 1.0003f, 0.9996f};
 
+    TuningFilterType tuningFilter = TuningFilterType::THIRIAN;
+
     //    1/44100 *(2^23) = 190.21786848072563
     //    (2^23)/190 = 44150.56842105263 0.1%
     //     190: 8bit
     using DeltaTimeT = FixedPoint<int32_t, 23>; // 1/44100
 
-    // static constexpr uint32_t sampleRate = 44100;
-    static constexpr uint32_t sampleRate = 32000;
-    // static constexpr uint32_t sampleRate = 22050;
+    // 以下はサンプリング周波数で決まるので setSampleRate で変える
+    uint32_t sampleRate = DEFAULT_SAMPLE_RATE;
+    int sampleRateIndex = findSampleRate(DEFAULT_SAMPLE_RATE);
+    float deltaT        = 1.0f / DEFAULT_SAMPLE_RATE;
+    DeltaTimeT deltaTF{1.0f / DEFAULT_SAMPLE_RATE};
+    DeltaTimeT deltaT_2F{0.5f / DEFAULT_SAMPLE_RATE};
 
-    static constexpr float deltaT = 1.0f / sampleRate;
-    static DeltaTimeT deltaTF;
-    static DeltaTimeT deltaT_2F;
+    // SAMPLE_RATES に無ければ false で何も変えない
+    bool setSampleRate(uint32_t fs);
 };
 
-constexpr size_t
-convertSampleSize(size_t s)
-{
-    return s * SystemParameters::sampleRate / 44100;
-}
-
 } // namespace physical_modeling_piano
 
 #endif /* _4438B837_7134_14C6_141F_F1B7870F56FE */
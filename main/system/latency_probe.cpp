@@ -0,0 +1,142 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Mon Oct 19 2026 1:12:50
+ */
+
+#include "latency_probe.h"
+#include <algorithm>
+#include <stdio.h>
+
+namespace sys
+{
+
+void
+LatencyHistogram::add(uint32_t us)
+{
+    int bin = us < 2 ? 0 : 31 - __builtin_clz(us);
+    ++bins_[std::min(bin, N_BINS - 1)];
+
+    min_ = count_ ? std::min(min_, us) : us;
+    max_ = std::max(max_, us);
+    sum_ += us;
+    ++count_;
+}
+
+uint32_t
+LatencyHistogram::estimatePercentile(int p) const
+{
+    uint64_t n   = (uint64_t(count_) * p + 99) / 100;
+    uint64_t acc = 0;
+    for (int i = 0; i < N_BINS; ++i)
+    {
+        acc += bins_[i];
+        if (acc >= n && acc)
+        {
+            return std::min(max_, (2u << i) - 1);
+        }
+    }
+    return max_;
+}
+
+void
+LatencyProbe::begin(uint32_t arrivalTime, uint32_t dequeueTime)
+{
+    state_       = State::WAIT_ONSET;
+    arrivalTime_ = arrivalTime;
+    dequeueTime_ = dequeueTime;
+}
+
+void
+LatencyProbe::setOnset(uint32_t samples)
+{
+    if (state_ == State::WAIT_ONSET)
+    {
+        onsetSamples_ = samples;
+        state_        = State::WAIT_ENCODE;
+    }
+}
+
+void
+LatencyProbe::blockEncoded(uint32_t time, uint32_t outputSamples)
+{
+    if (state_ != State::WAIT_ENCODE)
+    {
+        return;
+    }
+    state_ = State::IDLE;
+
+    histograms_[QUEUE].add(dequeueTime_ - arrivalTime_);
+    histograms_[ONSET].add(samplesToMicros(onsetSamples_));
+    histograms_[RENDER].add(time - dequeueTime_);
+    histograms_[OUTPUT].add(samplesToMicros(outputSamples));
+    histograms_[TOTAL].add(time - arrivalTime_);
+}
+
+void
+LatencyProbe::clear()
+{
+    for (auto& h : histograms_)
+    {
+        h.clear();
+    }
+}
+
+uint32_t
+LatencyProbe::samplesToMicros(uint32_t n) const
+{
+    return sampleRate_ ? uint32_t(uint64_t(n) * 1000000 / sampleRate_) : 0;
+}
+
+const char*
+LatencyProbe::getStageName(Stage s)
+{
+    static const char* names[] = {
+        "queue", "onset", "render", "output", "total"};
+    return names[s];
+}
+
+void
+LatencyProbe::print() const
+{
+    printf("latency [us]  count      min     mean      p50      p99      "
+           "max\n");
+    for (int i = 0; i < N_STAGES; ++i)
+    {
+        const auto& h = histograms_[i];
+        printf("%-10s %8u %8u %8u %8u %8u %8u\n",
+               getStageName(static_cast<Stage>(i)),
+               unsigned(h.getCount()),
+               unsigned(h.getMin()),
+               unsigned(h.getMean()),
+               unsigned(h.estimatePercentile(50)),
+               unsigned(h.estimatePercentile(99)),
+               unsigned(h.getMax()));
+    }
+
+    printf("histogram [us]");
+    for (int i = 0; i < N_STAGES; ++i)
+    {
+        printf(" %8s", getStageName(static_cast<Stage>(i)));
+    }
+    printf("\n");
+    for (int b = 0; b < LatencyHistogram::N_BINS; ++b)
+    {
+        uint32_t n = 0;
+        for (const auto& h : histograms_)
+        {
+            n += h.getBins()[b];
+        }
+        if (!n)
+        {
+            continue;
+        }
+        printf("< %-11u", 2u << b);
+        for (const auto& h : histograms_)
+        {
+            printf(" %8u", unsigned(h.getBins()[b]));
+        }
+        printf("\n");
+    }
+}
+
+} // namespace sys
@@ -0,0 +1,102 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Mon Oct 19 2026 1:4:22
+ */
+#ifndef _2B7E90C4_1134_1E2C_3A5D_C08F61E2B947
+#define _2B7E90C4_1134_1E2C_3A5D_C08F61E2B947
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sys
+{
+
+// [us] の値を 2^n ごとのビンで数える
+class LatencyHistogram
+{
+public:
+    static constexpr int N_BINS = 24; // bin i: [2^i, 2^(i+1)), bin 0 は [0, 2)
+
+private:
+    std::array<uint32_t, N_BINS> bins_{};
+    uint32_t count_{};
+    uint32_t min_{};
+    uint32_t max_{};
+    uint64_t sum_{};
+
+public:
+    void add(uint32_t us);
+    void clear() { *this = LatencyHistogram(); }
+
+    uint32_t getCount() const { return count_; }
+    uint32_t getMin() const { return min_; }
+    uint32_t getMax() const { return max_; }
+    uint32_t getMean() const { return count_ ? uint32_t(sum_ / count_) : 0; }
+    const std::array<uint32_t, N_BINS>& getBins() const { return bins_; }
+
+    // ビンの上端で見積もった p [%] 点
+    uint32_t estimatePercentile(int p) const;
+};
+
+// MIDI のノートオン到着から、その音の最初の出力がエンコーダを出るまで
+// 同時に計るのは 1音だけで、計測中に来たノートオンは数えない
+// 書き込みは音声タスクからのみ、読み出しは表示用なので多少ずれても構わない
+class LatencyProbe
+{
+public:
+    enum Stage
+    {
+        QUEUE,  // 到着 -> Piano::update で取り出すまで (ブロック境界待ち)
+        ONSET,  // キーオンしたブロックの先頭から最初の出力まで (音声の時間)
+        RENDER, // 取り出し -> 最初の出力を含むブロックをエンコードし終わるまで
+        OUTPUT, // エンコードした時点で DMA に積まれている分 (音声の時間)
+        TOTAL,  // 到着 -> エンコード完了 (QUEUE + RENDER)
+        N_STAGES,
+    };
+
+private:
+    enum class State
+    {
+        IDLE,
+        WAIT_ONSET,
+        WAIT_ENCODE,
+    };
+
+    State state_ = State::IDLE;
+    uint32_t sampleRate_{};
+    uint32_t arrivalTime_{};
+    uint32_t dequeueTime_{};
+    uint32_t onsetSamples_{};
+
+    std::array<LatencyHistogram, N_STAGES> histograms_;
+
+public:
+    void initialize(uint32_t sampleRate) { sampleRate_ = sampleRate; }
+
+    bool isIdle() const { return state_ == State::IDLE; }
+    bool isWaitingOnset() const { return state_ == State::WAIT_ONSET; }
+
+    void begin(uint32_t arrivalTime, uint32_t dequeueTime);
+    void setOnset(uint32_t samples);
+    void cancel() { state_ = State::IDLE; }
+
+    // outputSamples: エンコードした時点でまだ出力されていないサンプル数
+    void blockEncoded(uint32_t time, uint32_t outputSamples);
+
+    const LatencyHistogram& getHistogram(Stage s) const
+    {
+        return histograms_[s];
+    }
+    void clear();
+    void print() const;
+
+    static const char* getStageName(Stage s);
+
+protected:
+    uint32_t samplesToMicros(uint32_t n) const;
+};
+
+} // namespace sys
+
+#endif /* _2B7E90C4_1134_1E2C_3A5D_C08F61E2B947 */
@@ -6,6 +6,7 @@
 #include "nvs.h"
 #include <nvs.h>
 #include <nvs_flash.h>
+#include <stdio.h>
 
 namespace sys
 {
@@ -35,4 +36,74 @@ initializeNVS()
     return true;
 }
 
+bool
+readNVSBlob(const char* ns, const char* key, std::vector<uint8_t>& data)
+{
+    nvs_handle handle;
+    if (!initializeNVS() || nvs_open(ns, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return false;
+    }
+
+    size_t size = 0;
+    auto ret    = nvs_get_blob(handle, key, nullptr, &size);
+    if (ret == ESP_OK)
+    {
+        data.resize(size);
+        ret = nvs_get_blob(handle, key, data.data(), &size);
+    }
+    nvs_close(handle);
+    return ret == ESP_OK;
+}
+
+bool
+writeNVSBlob(const char* ns, const char* key, const void* data, size_t size)
+{
+    nvs_handle handle;
+    if (!initializeNVS() || nvs_open(ns, NVS_READWRITE, &handle) != ESP_OK)
+    {
+        return false;
+    }
+
+    // 上書きでは新しい blob を書いてから古いものを消すので両方の空きが要る
+    // (13KB 程度の表では 24KB の分割に入らない) 先に消しておく
+    auto ret = nvs_erase_key(handle, key);
+    if (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND)
+    {
+        ret = nvs_commit(handle);
+    }
+
+    // エントリは 32byte、blob はページごとに index などのエントリが増える
+    nvs_stats_t stats{};
+    if (ret == ESP_OK && nvs_get_stats(nullptr, &stats) == ESP_OK)
+    {
+        printf("%s: %s/%s %zd bytes, %zd/%zd entries free\n",
+               __func__,
+               ns,
+               key,
+               size,
+               stats.free_entries,
+               stats.total_entries);
+    }
+
+    if (ret == ESP_OK)
+    {
+        ret = nvs_set_blob(handle, key, data, size);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = nvs_commit(handle);
+    }
+    if (ret != ESP_OK)
+    {
+        printf("%s: %s/%s failed: %s\n",
+               __func__,
+               ns,
+               key,
+               esp_err_to_name(ret));
+    }
+    nvs_close(handle);
+    return ret == ESP_OK;
+}
+
 } // namespace sys
@@ -5,11 +5,23 @@
 #ifndef CEFCD123_2133_F0D1_26D7_187B66DB28EC
 #define CEFCD123_2133_F0D1_26D7_187B66DB28EC
 
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
 namespace sys
 {
 
 bool initializeNVS();
 
-}
+// ns/key の blob を読み書きする (無ければ false)
+// 書くときは古い blob を先に消す (失敗すると残らない)
+bool readNVSBlob(const char* ns, const char* key, std::vector<uint8_t>& data);
+bool writeNVSBlob(const char* ns,
+                  const char* key,
+                  const void* data,
+                  size_t size);
+
+} // namespace sys
 
 #endif /* CEFCD123_2133_F0D1_26D7_187B66DB28EC */
@@ -0,0 +1,122 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Mon Oct 19 2026 3:10:17
+ */
+
+#include "realtime_monitor.h"
+#include <algorithm>
+#include <stdio.h>
+
+namespace sys
+{
+
+void
+RealtimeMonitor::initialize(uint32_t blockSamples, uint32_t sampleRate)
+{
+    periodMicros_ = uint32_t(uint64_t(blockSamples) * 1000000 / sampleRate);
+}
+
+void
+RealtimeMonitor::recordBlock(uint32_t updateUs,
+                             uint32_t encodeUs,
+                             uint32_t writeUs)
+{
+    auto n   = blockCount_.load(std::memory_order_relaxed);
+    auto idx = n % RING_SIZE;
+
+    auto sat = [](uint32_t v) { return uint16_t(std::min(v, 65535u)); };
+    ring_[UPDATE][idx] = sat(updateUs);
+    ring_[ENCODE][idx] = sat(encodeUs);
+    ring_[WRITE][idx]  = sat(writeUs);
+
+    if (updateUs + encodeUs > periodMicros_)
+    {
+        overrunCount_.fetch_add(1, std::memory_order_relaxed);
+    }
+    blockCount_.store(n + 1, std::memory_order_release);
+}
+
+size_t
+RealtimeMonitor::getValidCount() const
+{
+    return std::min<size_t>(blockCount_.load(std::memory_order_acquire),
+                            RING_SIZE);
+}
+
+RealtimeMonitor::Stats
+RealtimeMonitor::getStats(Stage s) const
+{
+    Stats r{};
+    auto n = getValidCount();
+    if (!n)
+    {
+        return r;
+    }
+
+    std::array<uint16_t, RING_SIZE> v;
+    std::copy(ring_[s].begin(), ring_[s].begin() + n, v.begin());
+    std::sort(v.begin(), v.begin() + n);
+
+    uint32_t sum = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        sum += v[i];
+    }
+
+    r.min = v[0];
+    r.max = v[n - 1];
+    r.avg = sum / n;
+    r.p50 = v[n / 2];
+    r.p99 = v[(n * 99) / 100];
+    return r;
+}
+
+int
+RealtimeMonitor::getLoadPercent() const
+{
+    auto n = getValidCount();
+    if (!n || !periodMicros_)
+    {
+        return 0;
+    }
+
+    uint32_t sum = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        sum += ring_[UPDATE][i] + ring_[ENCODE][i];
+    }
+    return int(uint64_t(sum) * 100 / (uint64_t(n) * periodMicros_));
+}
+
+const char*
+RealtimeMonitor::getStageName(Stage s)
+{
+    static const char* names[] = {"update", "encode", "write"};
+    return names[s];
+}
+
+void
+RealtimeMonitor::print() const
+{
+    printf("block [us] (last %u of %u, period %u)\n",
+           unsigned(getValidCount()),
+           unsigned(getBlockCount()),
+           unsigned(periodMicros_));
+    printf("stage        min      avg      p50      p99      max\n");
+    for (int i = 0; i < N_STAGES; ++i)
+    {
+        auto s = getStats(static_cast<Stage>(i));
+        printf("%-8s %8u %8u %8u %8u %8u\n",
+               getStageName(static_cast<Stage>(i)),
+               unsigned(s.min),
+               unsigned(s.avg),
+               unsigned(s.p50),
+               unsigned(s.p99),
+               unsigned(s.max));
+    }
+    printf("load %d%%, overrun %u\n",
+           getLoadPercent(),
+           unsigned(getOverrunCount()));
+}
+
+} // namespace sys
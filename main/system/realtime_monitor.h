@@ -0,0 +1,71 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Mon Oct 19 2026 3:2:40
+ */
+#ifndef _51C8E3A9_7134_1E2C_6D20_B94F1A07C3E8
+#define _51C8E3A9_7134_1E2C_6D20_B94F1A07C3E8
+
+#include <array>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sys
+{
+
+// 音声タスクの 1ブロックごとの処理時間を直近 RING_SIZE ブロック分記録する
+// 書き込みは音声タスクのみ、読み出し (統計) は UI 側から
+// 読み出し中に書き換わっても表示用なので気にしない
+class RealtimeMonitor
+{
+public:
+    enum Stage
+    {
+        UPDATE, // Piano::update (sink への出力なら変換も含む)
+        ENCODE, // Piano::update の後の ΔΣ / PCM への変換
+        WRITE,  // 出力のリング (i2s_write) の空きを待っていた時間
+        N_STAGES,
+    };
+
+    static constexpr size_t RING_SIZE = 256;
+
+    struct Stats
+    {
+        uint32_t min;
+        uint32_t avg;
+        uint32_t max;
+        uint32_t p50;
+        uint32_t p99;
+    };
+
+private:
+    // [us] 65ms で飽和
+    std::array<std::array<uint16_t, RING_SIZE>, N_STAGES> ring_{};
+    std::atomic<uint32_t> blockCount_{0};
+    std::atomic<uint32_t> overrunCount_{0};
+    uint32_t periodMicros_{};
+
+public:
+    void initialize(uint32_t blockSamples, uint32_t sampleRate);
+
+    void recordBlock(uint32_t updateUs, uint32_t encodeUs, uint32_t writeUs);
+
+    Stats getStats(Stage s) const;
+    uint32_t getBlockCount() const { return blockCount_; }
+    // UPDATE + ENCODE がブロックの周期を超えた回数
+    uint32_t getOverrunCount() const { return overrunCount_; }
+    // 直近の UPDATE + ENCODE の平均のブロック周期に対する割合 [%]
+    int getLoadPercent() const;
+    uint32_t getPeriodMicros() const { return periodMicros_; }
+
+    void print() const;
+
+    static const char* getStageName(Stage s);
+
+protected:
+    size_t getValidCount() const;
+};
+
+} // namespace sys
+
+#endif /* _51C8E3A9_7134_1E2C_6D20_B94F1A07C3E8 */
@@ -0,0 +1,105 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Mon Oct 19 2026 4:1:36
+ */
+
+#include "trace.h"
+#include "util.h"
+#include <algorithm>
+#include <freertos/FreeRTOS.h>
+
+namespace sys
+{
+
+std::atomic<bool> TraceRecorder::enabled_{false};
+
+void
+TraceRecorder::initialize(size_t nRecords)
+{
+    size_t n = 1;
+    while (n < nRecords)
+    {
+        n <<= 1;
+    }
+
+    enabled_ = false;
+    records_.resize(n);
+    mask_ = n - 1;
+    head_ = 0;
+}
+
+void
+TraceRecorder::record(Event e, char phase, int32_t arg)
+{
+    auto i  = head_.fetch_add(1, std::memory_order_relaxed) & mask_;
+    auto& r = records_[i];
+    r.time  = micros();
+    r.event = e;
+    r.phase = phase;
+    r.tid   = xPortGetCoreID();
+    r.arg   = arg;
+}
+
+void
+TraceRecorder::writeChromeJSON(FILE* fp)
+{
+    enabled_ = false;
+
+    uint32_t head  = head_;
+    uint32_t n     = std::min<uint32_t>(head, records_.size());
+    uint32_t begin = head - n;
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        const auto& r = records_[(begin + i) & mask_];
+        fprintf(fp,
+                "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%u,\"pid\":0,"
+                "\"tid\":%d,",
+                getEventName(r.event),
+                r.phase,
+                unsigned(r.time),
+                r.tid);
+        if (r.phase == 'i')
+        {
+            fprintf(fp, "\"s\":\"t\",");
+        }
+        fprintf(fp,
+                "\"args\":{\"arg\":%d}}%s\n",
+                int(r.arg),
+                i + 1 < n ? "," : "");
+    }
+    fprintf(fp, "],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+const char*
+TraceRecorder::getEventName(Event e)
+{
+    static const char* names[] = {
+        "block",
+        "note_update",
+        "worker_start",
+        "worker",
+        "sync_wait",
+        "voice",
+        "key_on",
+        "key_off",
+        "restrike",
+        "steal",
+        "midi_put",
+        "midi_get",
+        "midi_drop",
+        "memory_clear",
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == N_EVENTS, "");
+    return names[e];
+}
+
+TraceRecorder&
+TraceRecorder::instance()
+{
+    static TraceRecorder inst;
+    return inst;
+}
+
+} // namespace sys
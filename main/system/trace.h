@@ -0,0 +1,105 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Mon Oct 19 2026 3:48:12
+ */
+#ifndef _9E24B7D0_8134_1E2C_0F6A_5C3D81E49B27
+#define _9E24B7D0_8134_1E2C_0F6A_5C3D81E49B27
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// 0 にすると TRACE_* は何も生成しない
+#ifndef ENABLE_TRACE
+#define ENABLE_TRACE 1
+#endif
+
+namespace sys
+{
+
+// 時刻付きイベントのリングバッファ (古いものから上書き)
+// 複数のタスクから書いてよい。Chrome の trace JSON (Perfetto でも読める) で出力する
+// tid はコア番号 (host ではスレッドの通し番号)
+class TraceRecorder
+{
+public:
+    enum Event : uint8_t
+    {
+        BLOCK,        // Piano::update
+        NOTE_UPDATE,  // NoteManager::update
+        WORKER_START, // worker に START を送った
+        WORKER,       // worker の process
+        SYNC_WAIT,    // worker の終了待ち
+        VOICE,        // 1ボイスの描画 (arg: note)
+        KEY_ON,       // arg: note
+        KEY_OFF,      // arg: note
+        RESTRIKE,     // arg: note
+        STEAL,        // 奪ったボイス (arg: note)
+        MIDI_PUT,     // MidiMessageQueue に積んだ (arg: status << 8 | data1)
+        MIDI_GET,     // Piano::update で取り出した (arg: 同上)
+        MIDI_DROP,    // 一杯で捨てた (arg: 同上)
+        MEMORY_CLEAR, // worker での遅延線メモリのクリア
+        N_EVENTS,
+    };
+
+private:
+    struct Record
+    {
+        uint32_t time; // [us]
+        Event event;
+        char phase; // 'B', 'E', 'i'
+        uint8_t tid;
+        int32_t arg;
+    };
+
+    std::vector<Record> records_;
+    uint32_t mask_{};
+    std::atomic<uint32_t> head_{0};
+
+    static std::atomic<bool> enabled_;
+
+public:
+    // nRecords は 2^n に切り上げる
+    void initialize(size_t nRecords);
+
+    void setEnabled(bool f) { enabled_ = f && !records_.empty(); }
+    static bool isEnabled()
+    {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    void record(Event e, char phase, int32_t arg);
+    void clear() { head_ = 0; }
+
+    // 記録を止めて書き出す
+    void writeChromeJSON(FILE* fp);
+
+    static const char* getEventName(Event e);
+    static TraceRecorder& instance();
+};
+
+} // namespace sys
+
+#if ENABLE_TRACE
+#define TRACE_EVENT_(e, phase, arg)                                            \
+    do                                                                         \
+    {                                                                          \
+        if (sys::TraceRecorder::isEnabled())                                   \
+        {                                                                      \
+            sys::TraceRecorder::instance().record(                             \
+                sys::TraceRecorder::e, phase, arg);                            \
+        }                                                                      \
+    } while (0)
+#else
+#define TRACE_EVENT_(e, phase, arg)                                            \
+    do                                                                         \
+    {                                                                          \
+    } while (0)
+#endif
+
+#define TRACE_BEGIN(e, arg) TRACE_EVENT_(e, 'B', arg)
+#define TRACE_END(e, arg) TRACE_EVENT_(e, 'E', arg)
+#define TRACE_INSTANT(e, arg) TRACE_EVENT_(e, 'i', arg)
+
+#endif /* _9E24B7D0_8134_1E2C_0F6A_5C3D81E49B27 */
@@ -12,7 +12,7 @@
     extern const uint8_t x##_end[] asm("_binary_" #x "_end");
 
 #define GET_LINKED_BINARY(x) x##_start
-#define GET_LINKED_BINARY_SIZE(x) (x##_end - x##start)
+#define GET_LINKED_BINARY_SIZE(x) (x##_end - x##_start)
 
 #define GET_LINKED_BINARY_T(t, x) reinterpret_cast<const t*>(x##_start)
 
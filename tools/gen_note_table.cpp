@@ -0,0 +1,93 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 5:58:17
+ *
+ * 既定の SystemParameters の Note の係数表を作る (host用)
+ * 本体のビルドで main/component.mk から呼ばれ、結果をフラッシュに埋め込む
+ *
+ * build:
+ *   g++ -std=c++1z -O2 -Imain tools/gen_note_table.cpp \
+ *       main/pm_piano/{allocator,filter,hammer,note,note_table,string,\
+ *       sys_params}.cpp -o gen_note_table
+ *
+ * usage:
+ *   ./gen_note_table <out.bin> [sampleRate]
+ */
+
+#include <pm_piano/note.h>
+#include <pm_piano/note_table.h>
+#include <pm_piano/sys_params.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace physical_modeling_piano;
+
+namespace
+{
+
+// NoteManager と同じ 88 鍵
+constexpr int NOTE_BEGIN = 21;
+constexpr int N_NOTES    = 88;
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("usage: %s <out.bin> [sampleRate]\n", argv[0]);
+        return 1;
+    }
+
+    SystemParameters sysParams;
+    if (argc > 2 && !sysParams.setSampleRate(atoi(argv[2])))
+    {
+        printf("unsupported sample rate %s\n", argv[2]);
+        return 1;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<Note> notes(N_NOTES);
+    auto t0 = Clock::now();
+    computeNotes(notes.data(), N_NOTES, NOTE_BEGIN, sysParams);
+    auto t1    = Clock::now();
+    auto table = saveNoteTable(notes.data(), N_NOTES, sysParams);
+
+    // 読み戻して同じになることを確かめる
+    std::vector<Note> loaded(N_NOTES);
+    auto t2 = Clock::now();
+    bool ok = loadNoteTable(loaded.data(),
+                            N_NOTES,
+                            sysParams,
+                            table.data(),
+                            table.size());
+    auto t3 = Clock::now();
+    if (!ok || saveNoteTable(loaded.data(), N_NOTES, sysParams) != table)
+    {
+        printf("reload mismatch\n");
+        return 1;
+    }
+
+    auto* fp = fopen(argv[1], "wb");
+    if (!fp)
+    {
+        printf("can't open %s\n", argv[1]);
+        return 1;
+    }
+    fwrite(table.data(), 1, table.size(), fp);
+    fclose(fp);
+
+    using us = std::chrono::duration<double, std::micro>;
+    printf("note table: %d Hz, key %08x, %zd bytes, "
+           "compute %.0f us, load %.0f us (host)\n",
+           int(sysParams.sampleRate),
+           unsigned(computeNoteTableKey(sysParams)),
+           table.size(),
+           us(t1 - t0).count(),
+           us(t3 - t2).count());
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Mon Oct 19 2026 2:33:48
+ */
+
+#include "alloc_counter.h"
+#include <atomic>
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+// glibc の本体
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t n, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+extern "C" void* __libc_memalign(size_t align, size_t size);
+
+namespace host
+{
+namespace
+{
+std::atomic<bool> enabled_{false};
+std::atomic<bool> abortOnAlloc_{false};
+std::atomic<uint32_t> count_{0};
+
+inline void
+countAllocation()
+{
+    if (enabled_.load(std::memory_order_relaxed))
+    {
+        count_.fetch_add(1, std::memory_order_relaxed);
+        if (abortOnAlloc_.load(std::memory_order_relaxed))
+        {
+            abort();
+        }
+    }
+}
+} // namespace
+
+void
+setAllocationCounting(bool enable, bool abortOnAlloc)
+{
+    abortOnAlloc_ = abortOnAlloc;
+    enabled_      = enable;
+}
+
+uint32_t
+getAllocationCount()
+{
+    return count_;
+}
+
+void
+resetAllocationCount()
+{
+    count_ = 0;
+}
+
+} // namespace host
+
+extern "C" void*
+malloc(size_t size)
+{
+    host::countAllocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void*
+calloc(size_t n, size_t size)
+{
+    host::countAllocation();
+    return __libc_calloc(n, size);
+}
+
+extern "C" void*
+realloc(void* p, size_t size)
+{
+    host::countAllocation();
+    return __libc_realloc(p, size);
+}
+
+extern "C" void*
+aligned_alloc(size_t align, size_t size)
+{
+    host::countAllocation();
+    return __libc_memalign(align, size);
+}
+
+extern "C" void*
+memalign(size_t align, size_t size)
+{
+    host::countAllocation();
+    return __libc_memalign(align, size);
+}
+
+extern "C" int
+posix_memalign(void** p, size_t align, size_t size)
+{
+    host::countAllocation();
+    *p = __libc_memalign(align, size);
+    return *p ? 0 : ENOMEM;
+}
@@ -0,0 +1,25 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Mon Oct 19 2026 2:31:5
+ *
+ * host 用: malloc 系を横取りしてヒープ確保を数える
+ * operator new も libstdc++ の中で malloc を呼ぶのでここで数えられる
+ * (sanitizer とは併用できない)
+ */
+#ifndef _7D3F0A62_E134_1E2C_51B9_A4C86E2D1F05
+#define _7D3F0A62_E134_1E2C_51B9_A4C86E2D1F05
+
+#include <stdint.h>
+
+namespace host
+{
+
+// 有効な間、全スレッドの確保を数える
+// abortOnAlloc なら最初の確保で abort する (デバッガで呼び出し元を見る用)
+void setAllocationCounting(bool enable, bool abortOnAlloc = false);
+uint32_t getAllocationCount();
+void resetAllocationCount();
+
+} // namespace host
+
+#endif /* _7D3F0A62_E134_1E2C_51B9_A4C86E2D1F05 */
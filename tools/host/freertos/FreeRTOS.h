@@ -0,0 +1,50 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sun Oct 18 2026 23:41:10
+ *
+ * host でビルドするための FreeRTOS の最小限の代用品
+ */
+#ifndef _3F1C7A20_B134_1E2A_9C41_5D8E0B7A21C6
+#define _3F1C7A20_B134_1E2A_9C41_5D8E0B7A21C6
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+
+typedef uint32_t EventBits_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void* TaskHandle_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffffu
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms)) // tick は 1ms とする
+
+namespace freertos_host
+{
+
+struct EventGroup
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    EventBits_t bits{};
+};
+
+} // namespace freertos_host
+
+typedef freertos_host::EventGroup* EventGroupHandle_t;
+
+// host ではスレッドの通し番号をコア番号の代わりにする
+inline BaseType_t
+xPortGetCoreID()
+{
+    static std::atomic<int> count{0};
+    thread_local int id = count++;
+    return id;
+}
+
+#endif /* _3F1C7A20_B134_1E2A_9C41_5D8E0B7A21C6 */
@@ -0,0 +1,65 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sun Oct 18 2026 23:41:10
+ */
+#ifndef _8A0D5E42_C134_1E2A_7B13_2E9F4C6D10A8
+#define _8A0D5E42_C134_1E2A_7B13_2E9F4C6D10A8
+
+#include "FreeRTOS.h"
+#include <chrono>
+
+inline EventGroupHandle_t
+xEventGroupCreate()
+{
+    return new freertos_host::EventGroup;
+}
+
+inline EventBits_t
+xEventGroupSetBits(EventGroupHandle_t g, EventBits_t bits)
+{
+    std::lock_guard<std::mutex> lock(g->mutex);
+    g->bits |= bits;
+    g->cond.notify_all();
+    return g->bits;
+}
+
+inline EventBits_t
+xEventGroupClearBits(EventGroupHandle_t g, EventBits_t bits)
+{
+    std::lock_guard<std::mutex> lock(g->mutex);
+    auto r = g->bits;
+    g->bits &= ~bits;
+    return r;
+}
+
+// ticks は ms として扱う
+inline EventBits_t
+xEventGroupWaitBits(EventGroupHandle_t g,
+                    EventBits_t bits,
+                    BaseType_t clearOnExit,
+                    BaseType_t waitForAllBits,
+                    TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(g->mutex);
+    auto pred = [&] {
+        return waitForAllBits ? (g->bits & bits) == bits : (g->bits & bits);
+    };
+    bool satisfied = true;
+    if (ticks == portMAX_DELAY)
+    {
+        g->cond.wait(lock, pred);
+    }
+    else
+    {
+        satisfied =
+            g->cond.wait_for(lock, std::chrono::milliseconds(ticks), pred);
+    }
+    auto r = g->bits;
+    if (satisfied && clearOnExit)
+    {
+        g->bits &= ~bits;
+    }
+    return r;
+}
+
+#endif /* _8A0D5E42_C134_1E2A_7B13_2E9F4C6D10A8 */
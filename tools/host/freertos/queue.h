@@ -0,0 +1,108 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Mon Oct 19 2026 1:40:18
+ */
+#ifndef _E0A45C1D_6134_1E2C_8F07_39B2D4A6C5E1
+#define _E0A45C1D_6134_1E2C_8F07_39B2D4A6C5E1
+
+#include "FreeRTOS.h"
+#include <chrono>
+#include <deque>
+#include <string.h>
+#include <vector>
+
+namespace freertos_host
+{
+
+struct Queue
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t capacity{};
+    size_t itemSize{};
+    std::deque<std::vector<uint8_t>> items;
+
+    // ticks は ms として扱う
+    template <class Pred>
+    bool wait(std::unique_lock<std::mutex>& lock, TickType_t ticks, Pred pred)
+    {
+        if (ticks == portMAX_DELAY)
+        {
+            cond.wait(lock, pred);
+            return true;
+        }
+        return cond.wait_for(lock, std::chrono::milliseconds(ticks), pred);
+    }
+};
+
+} // namespace freertos_host
+
+typedef freertos_host::Queue* QueueHandle_t;
+
+inline QueueHandle_t
+xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    auto* q     = new freertos_host::Queue;
+    q->capacity = length;
+    q->itemSize = itemSize;
+    return q;
+}
+
+inline void
+vQueueDelete(QueueHandle_t q)
+{
+    delete q;
+}
+
+inline BaseType_t
+xQueueSend(QueueHandle_t q, const void* item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(q->mutex);
+    if (!q->wait(lock, ticks, [q] { return q->items.size() < q->capacity; }))
+    {
+        return pdFALSE;
+    }
+    auto* p = static_cast<const uint8_t*>(item);
+    q->items.emplace_back(p, p + q->itemSize);
+    q->cond.notify_all();
+    return pdTRUE;
+}
+
+inline BaseType_t
+xQueueReceive(QueueHandle_t q, void* item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(q->mutex);
+    if (!q->wait(lock, ticks, [q] { return !q->items.empty(); }))
+    {
+        return pdFALSE;
+    }
+    memcpy(item, q->items.front().data(), q->itemSize);
+    q->items.pop_front();
+    q->cond.notify_all();
+    return pdTRUE;
+}
+
+inline BaseType_t
+xQueueReset(QueueHandle_t q)
+{
+    std::lock_guard<std::mutex> lock(q->mutex);
+    q->items.clear();
+    q->cond.notify_all();
+    return pdPASS;
+}
+
+inline UBaseType_t
+uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    std::lock_guard<std::mutex> lock(q->mutex);
+    return q->items.size();
+}
+
+inline UBaseType_t
+uxQueueSpacesAvailable(QueueHandle_t q)
+{
+    std::lock_guard<std::mutex> lock(q->mutex);
+    return q->capacity - q->items.size();
+}
+
+#endif /* _E0A45C1D_6134_1E2C_8F07_39B2D4A6C5E1 */
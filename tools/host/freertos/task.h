@@ -0,0 +1,28 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sun Oct 18 2026 23:41:10
+ */
+#ifndef _C5B2917E_D134_1E2A_4E88_71A3F0B9D5E2
+#define _C5B2917E_D134_1E2A_4E88_71A3F0B9D5E2
+
+#include "FreeRTOS.h"
+#include <thread>
+
+// タスクは std::thread で動かしっぱなしにする
+inline BaseType_t
+xTaskCreate(void (*func)(void*),
+            const char*,
+            uint32_t,
+            void* param,
+            int,
+            TaskHandle_t* handle)
+{
+    std::thread(func, param).detach();
+    if (handle)
+    {
+        *handle = nullptr;
+    }
+    return pdPASS;
+}
+
+#endif /* _C5B2917E_D134_1E2A_4E88_71A3F0B9D5E2 */
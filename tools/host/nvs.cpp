@@ -0,0 +1,69 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Tue Oct 20 2026 6:41:27
+ *
+ * host 用の system/nvs.cpp の代わり
+ * blob は NVS と同じバイト列をカレントの nvs_<ns>_<key>.bin に置く
+ */
+
+#include <stdio.h>
+#include <string>
+#include <system/nvs.h>
+
+namespace sys
+{
+
+namespace
+{
+
+std::string
+makeBlobPath(const char* ns, const char* key)
+{
+    return std::string("nvs_") + ns + "_" + key + ".bin";
+}
+
+} // namespace
+
+bool
+initializeNVS()
+{
+    return true;
+}
+
+bool
+readNVSBlob(const char* ns, const char* key, std::vector<uint8_t>& data)
+{
+    auto* fp = fopen(makeBlobPath(ns, key).c_str(), "rb");
+    if (!fp)
+    {
+        return false;
+    }
+
+    data.clear();
+    uint8_t buf[1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(fp);
+    return true;
+}
+
+bool
+writeNVSBlob(const char* ns, const char* key, const void* data, size_t size)
+{
+    // 本体と同じく古いものを先に消す
+    auto path = makeBlobPath(ns, key);
+    remove(path.c_str());
+
+    auto* fp = fopen(path.c_str(), "wb");
+    if (!fp)
+    {
+        return false;
+    }
+    bool ok = fwrite(data, 1, size, fp) == size;
+    return fclose(fp) == 0 && ok;
+}
+
+} // namespace sys
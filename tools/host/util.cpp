@@ -0,0 +1,47 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Mon Oct 19 2026 4:20:51
+ *
+ * host 用の system/util.cpp の代わり (本体では esp_timer)
+ */
+
+#include <chrono>
+#include <system/util.h>
+#include <thread>
+
+namespace sys
+{
+
+void
+yield()
+{
+    std::this_thread::yield();
+}
+
+uint32_t
+micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+uint32_t
+millis()
+{
+    return micros() / 1000;
+}
+
+void
+delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void
+delayMicroseconds(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+} // namespace sys
@@ -0,0 +1,603 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sun Oct 18 2026 21:24:8
+ *
+ * 音源カーネルのベンチマーク (host用)
+ *
+ * build:
+ *   g++ -std=c++1z -O2 -Imain tools/pm_bench.cpp \
+ *       main/pm_piano/{allocator,convolution_soundboard,filter,hammer,note,\
+ *       real_fft,soundboard,string,sys_params}.cpp \
+ *       main/audio/upsampler.cpp -o pm_bench
+ *
+ * usage:
+ *   ./pm_bench [filter]   名前に filter を含むものだけ実行
+ */
+
+#include <audio/upsampler.h>
+#include <pm_piano/convolution_soundboard.h>
+#include <pm_piano/filter.h>
+#include <pm_piano/note.h>
+#include <pm_piano/soundboard.h>
+#include <pm_piano/string.h>
+#include <pm_piano/sys_params.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace physical_modeling_piano;
+
+namespace
+{
+
+constexpr size_t N_SAMPLES = 1 << 16;
+
+struct Benchmark
+{
+    const char* name;
+    // 入力 n サンプル分を処理する
+    std::function<void(size_t n)> func;
+};
+
+std::vector<Benchmark>&
+getBenchmarks()
+{
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct Register
+{
+    Register(const char* name, std::function<void(size_t)> func)
+    {
+        getBenchmarks().push_back({name, std::move(func)});
+    }
+};
+
+#define PM_BENCH_CONCAT2(a, b) a##b
+#define PM_BENCH_CONCAT(a, b) PM_BENCH_CONCAT2(a, b)
+#define PM_BENCHMARK(name, func)                                               \
+    Register PM_BENCH_CONCAT(register_, __LINE__)(name, func)
+
+// 最適化で消されないように結果を逃がす
+volatile int32_t sink_;
+
+template <class T>
+void
+consume(const T& v)
+{
+    sink_ = *reinterpret_cast<const int32_t*>(&v);
+}
+
+// ハードウェアカウンタ (使えない環境では valid() が false)
+class PerfCounter
+{
+    int fd_ = -1;
+
+public:
+    PerfCounter(uint32_t type, uint64_t config)
+    {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.size           = sizeof(attr);
+        attr.type           = type;
+        attr.config         = config;
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    ~PerfCounter()
+    {
+#ifdef __linux__
+        if (fd_ >= 0)
+        {
+            close(fd_);
+        }
+#endif
+    }
+
+    bool valid() const { return fd_ >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd_ >= 0)
+        {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    uint64_t stop()
+    {
+        uint64_t v = 0;
+#ifdef __linux__
+        if (fd_ >= 0)
+        {
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &v, sizeof(v)) != sizeof(v))
+            {
+                v = 0;
+            }
+        }
+#endif
+        return v;
+    }
+};
+
+struct Result
+{
+    double ns;
+    double cycles; // 負なら計測できない
+    double l1dMisses;
+};
+
+Result
+measure(const Benchmark& b)
+{
+    using Clock = std::chrono::steady_clock;
+
+#ifdef __linux__
+    PerfCounter cycles(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    PerfCounter misses(PERF_TYPE_HW_CACHE,
+                       PERF_COUNT_HW_CACHE_L1D |
+                           (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#else
+    PerfCounter cycles(0, 0);
+    PerfCounter misses(0, 0);
+#endif
+
+    b.func(N_SAMPLES); // warm up
+
+    Result best{1e30, -1, -1};
+    for (int i = 0; i < 7; ++i)
+    {
+        cycles.start();
+        misses.start();
+        auto t0 = Clock::now();
+        b.func(N_SAMPLES);
+        auto t1 = Clock::now();
+        auto nc = cycles.stop();
+        auto nm = misses.stop();
+
+        double ns =
+            std::chrono::duration<double, std::nano>(t1 - t0).count() /
+            N_SAMPLES;
+        if (ns < best.ns)
+        {
+            best.ns        = ns;
+            best.cycles    = cycles.valid() ? double(nc) / N_SAMPLES : -1;
+            best.l1dMisses = misses.valid() ? double(nm) / N_SAMPLES : -1;
+        }
+    }
+    return best;
+}
+
+std::vector<String::FilterSampleT>
+makeNoise(size_t n)
+{
+    std::vector<String::FilterSampleT> r(n);
+    uint32_t seed = 12345;
+    for (auto& v : r)
+    {
+        seed = seed * 1664525 + 1013904223;
+        v    = ((int32_t)seed >> 8) * (1.0f / (1 << 23));
+    }
+    return r;
+}
+
+////
+// 分散フィルタ: biquad 毎の呼び出しと融合カスケード
+
+constexpr float dispersionB = 0.00012f;
+constexpr float dispersionF = 110.0f;
+
+template <int M>
+void
+runDispersionBiquads(size_t n)
+{
+    using Filter =
+        ThirianDispersionFilter<String::FilterConstT, String::FilterHistoryT>;
+    static const auto input = makeNoise(N_SAMPLES);
+
+    Filter filters[4];
+    Filter::State states[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        if (i < M)
+        {
+            filters[i].initialize(dispersionB, dispersionF, M);
+        }
+        else
+        {
+            filters[i].reset();
+        }
+        filters[i].clear(states[i]);
+    }
+
+    // 旧 String::filterH と同じく常に 4段呼ぶ
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto y = input[i];
+        y      = filters[0].filter(y, states[0]);
+        y      = filters[1].filter(y, states[1]);
+        y      = filters[2].filter(y, states[2]);
+        y      = filters[3].filter(y, states[3]);
+        consume(y);
+    }
+}
+
+template <int M>
+void
+runDispersionCascade(size_t n)
+{
+    static const auto input = makeNoise(N_SAMPLES);
+
+    String::DispersionFilterT filter;
+    String::DispersionFilterT::State state;
+    filter.initialize(dispersionB, dispersionF, M);
+    filter.clear(state);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        consume(filter.filter<M>(input[i], state));
+    }
+}
+
+PM_BENCHMARK("dispersion/biquads/M=1", runDispersionBiquads<1>);
+PM_BENCHMARK("dispersion/biquads/M=4", runDispersionBiquads<4>);
+PM_BENCHMARK("dispersion/cascade/M=1", runDispersionCascade<1>);
+PM_BENCHMARK("dispersion/cascade/M=4", runDispersionCascade<4>);
+
+////
+// 遅延線: 2^n バッファのマスクと遅延長ちょうどのバッファ
+
+constexpr size_t delayLength = 301;
+
+template <class DelayStateT>
+void
+runDelay(size_t n, size_t bufferSize)
+{
+    static const auto input = makeNoise(N_SAMPLES);
+
+    std::vector<String::StringSampleT> buffer(bufferSize);
+    DelayStateT state(buffer.data(), bufferSize);
+    state.clear(delayLength);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        consume(state.update(input[i], delayLength));
+    }
+}
+
+PM_BENCHMARK("delay/pow2", [](size_t n) {
+    runDelay<DelayState<String::StringSampleT>>(
+        n, computeDelayBufferSize(delayLength));
+});
+PM_BENCHMARK("delay/exact", [](size_t n) {
+    runDelay<ExactDelayState<String::StringSampleT>>(
+        n, computeExactDelayBufferSize(delayLength));
+});
+
+PM_BENCHMARK("delay/int16", [](size_t n) {
+    static std::vector<int16_t> buffer(delayLength);
+    CompressedDelayState<String::StringSampleT> state(buffer.data(),
+                                                      delayLength);
+    state.clear(delayLength);
+    state.setShift(8);
+
+    static const auto input = makeNoise(N_SAMPLES);
+    for (size_t i = 0; i < n; ++i)
+    {
+        consume(state.update(input[i], delayLength));
+    }
+});
+
+////
+// ノート 1 音の描画 (soundboard は含まない)
+
+template <int KEY>
+void
+runNote(size_t n)
+{
+    static SystemParameters sysParams;
+    static Note note = [] {
+        Note r;
+        r.initialize(440 * powf(2.0f, (KEY - 69) / 12.0f), sysParams);
+        return r;
+    }();
+    static std::vector<uint32_t> buffer(note.computeAllocatorSize() / 4 + 1);
+
+    PedalState pedal;
+    pedal.setDamper(true);
+
+    Note::State state;
+    state.attachBuffer(buffer.data(), buffer.size() * sizeof(uint32_t));
+    note.keyOn(state, 5.0f);
+
+    constexpr size_t BLOCK_SIZE = 128;
+    Note::SampleT samples[BLOCK_SIZE];
+    for (size_t i = 0; i < n; i += BLOCK_SIZE)
+    {
+        std::fill(std::begin(samples), std::end(samples), 0);
+        note.update(samples, BLOCK_SIZE, state, sysParams, pedal);
+        consume(samples[0]);
+    }
+}
+
+PM_BENCHMARK("note/A0", runNote<21>);
+PM_BENCHMARK("note/C4", runNote<60>);
+PM_BENCHMARK("note/C7", runNote<96>);
+
+////
+// soundboard: 1 サンプルずつと最短遅延長ごとのブロック処理、遅延線の数と帰還行列
+
+template <class SoundboardT, bool BLOCK = true>
+void
+runSoundboard(size_t n)
+{
+    static SystemParameters sysParams;
+    static SoundboardT soundboard = [] {
+        SoundboardT r;
+        r.initialize(sysParams);
+        return r;
+    }();
+    static const std::vector<SoundboardTypes::ValueT> input = [] {
+        auto noise = makeNoise(N_SAMPLES);
+        return std::vector<SoundboardTypes::ValueT>(noise.begin(), noise.end());
+    }();
+
+    constexpr size_t BLOCK_SIZE = 128;
+    SoundboardTypes::ResultT samples[BLOCK_SIZE];
+    for (size_t i = 0; i < n; i += BLOCK_SIZE)
+    {
+        const auto* src = &input[i % N_SAMPLES];
+        if (BLOCK)
+        {
+            soundboard.update(samples, src, BLOCK_SIZE);
+        }
+        else
+        {
+            soundboard.updateSerial(samples, src, BLOCK_SIZE);
+        }
+        consume(samples[0]);
+    }
+}
+
+PM_BENCHMARK("soundboard/serial",
+             (runSoundboard<BasicSoundboard<8, SumDifferenceMixer>, false>));
+PM_BENCHMARK("soundboard/sumdiff/N=4",
+             (runSoundboard<BasicSoundboard<4, SumDifferenceMixer>>));
+PM_BENCHMARK("soundboard/sumdiff/N=8",
+             (runSoundboard<BasicSoundboard<8, SumDifferenceMixer>>));
+PM_BENCHMARK("soundboard/sumdiff/N=16",
+             (runSoundboard<BasicSoundboard<16, SumDifferenceMixer>>));
+PM_BENCHMARK("soundboard/hadamard/N=4",
+             (runSoundboard<BasicSoundboard<4, HadamardMixer>>));
+PM_BENCHMARK("soundboard/hadamard/N=8",
+             (runSoundboard<BasicSoundboard<8, HadamardMixer>>));
+PM_BENCHMARK("soundboard/hadamard/N=16",
+             (runSoundboard<BasicSoundboard<16, HadamardMixer>>));
+
+////
+// 畳み込みの soundboard: パーティション長 B とインパルス応答の長さ
+// update は 256 サンプルずつ (64-256 のどのブロック長でも B ごとに処理する)
+
+template <size_t B, int IR_MS>
+void
+runConvolution(size_t n)
+{
+    static SystemParameters sysParams;
+    static ConvolutionSoundboard soundboard = [] {
+        ConvolutionSoundboard r;
+        r.initialize(sysParams, B);
+
+        // 指数減衰する雑音
+        auto h = makeNoise(sysParams.sampleRate * IR_MS / 1000);
+        for (size_t i = 0; i < h.size(); ++i)
+        {
+            h[i] = float(h[i]) * expf(-6.9f * i / h.size());
+        }
+        std::vector<float> hf(h.begin(), h.end());
+        r.setImpulseResponse(hf.data(), hf.size());
+        return r;
+    }();
+    static const std::vector<SoundboardTypes::ValueT> input = [] {
+        auto noise = makeNoise(N_SAMPLES);
+        std::vector<SoundboardTypes::ValueT> r(noise.size());
+        for (size_t i = 0; i < r.size(); ++i)
+        {
+            r[i] = float(noise[i]) * 0.01f;
+        }
+        return r;
+    }();
+
+    constexpr size_t BLOCK_SIZE = 256;
+    SoundboardTypes::ResultT samples[BLOCK_SIZE];
+    for (size_t i = 0; i < n; i += BLOCK_SIZE)
+    {
+        soundboard.update(samples, &input[i % N_SAMPLES], BLOCK_SIZE);
+        consume(samples[0]);
+    }
+}
+
+PM_BENCHMARK("convolution/B=32/ir=0.5s", (runConvolution<32, 500>));
+PM_BENCHMARK("convolution/B=64/ir=0.5s", (runConvolution<64, 500>));
+PM_BENCHMARK("convolution/B=128/ir=0.5s", (runConvolution<128, 500>));
+PM_BENCHMARK("convolution/B=256/ir=0.5s", (runConvolution<256, 500>));
+PM_BENCHMARK("convolution/B=32/ir=1s", (runConvolution<32, 1000>));
+PM_BENCHMARK("convolution/B=64/ir=1s", (runConvolution<64, 1000>));
+PM_BENCHMARK("convolution/B=128/ir=1s", (runConvolution<128, 1000>));
+PM_BENCHMARK("convolution/B=256/ir=1s", (runConvolution<256, 1000>));
+PM_BENCHMARK("convolution/B=32/ir=2s", (runConvolution<32, 2000>));
+PM_BENCHMARK("convolution/B=64/ir=2s", (runConvolution<64, 2000>));
+PM_BENCHMARK("convolution/B=128/ir=2s", (runConvolution<128, 2000>));
+PM_BENCHMARK("convolution/B=256/ir=2s", (runConvolution<256, 2000>));
+
+////
+// 内蔵 DAC 用の 4倍補間 (値は入力 1 サンプルあたり)
+
+template <class Upsampler>
+void
+runUpsampler(size_t n)
+{
+    constexpr size_t BLOCK_SIZE = 128;
+    static Upsampler upsampler = [] {
+        Upsampler r;
+        r.initialize(BLOCK_SIZE);
+        return r;
+    }();
+    static const std::vector<int32_t> input = [] {
+        auto noise = makeNoise(N_SAMPLES);
+        std::vector<int32_t> r(noise.size());
+        for (size_t i = 0; i < r.size(); ++i)
+        {
+            r[i] = int32_t(float(noise[i]) * 16000);
+        }
+        return r;
+    }();
+
+    int32_t samples[BLOCK_SIZE * audio::UPSAMPLE_FACTOR];
+    for (size_t i = 0; i < n; i += BLOCK_SIZE)
+    {
+        upsampler.process(samples, &input[i % N_SAMPLES], BLOCK_SIZE);
+        consume(samples[0]);
+    }
+}
+
+PM_BENCHMARK("upsample/linear", runUpsampler<audio::LinearUpsampler>);
+PM_BENCHMARK("upsample/fir/T=4", runUpsampler<audio::PolyphaseUpsampler<4>>);
+PM_BENCHMARK("upsample/fir/T=8", runUpsampler<audio::PolyphaseUpsampler<8>>);
+PM_BENCHMARK("upsample/fir/T=16",
+             runUpsampler<audio::PolyphaseUpsampler<16>>);
+
+////
+// 16 ボイス同時の描画
+// shared: 88 鍵分の Note を参照する (以前の NoteManager の配置)
+// copied: キーオン時に描画用の係数 (Note::Kernel) を State の隣に複製する
+
+constexpr int N_VOICES = 16;
+
+template <bool COPY>
+struct VoiceBench
+{
+    struct Voice
+    {
+        Note::State state;
+        Note::Kernel kernel; // COPY の場合のみ使う
+        int key;
+        std::vector<uint32_t> buffer;
+    };
+
+    SystemParameters sysParams;
+    std::vector<Note> notes;
+    std::vector<Voice> voices;
+    PedalState pedal;
+
+    VoiceBench()
+        : notes(88)
+        , voices(N_VOICES)
+    {
+        for (int i = 0; i < 88; ++i)
+        {
+            notes[i].initialize(440 * powf(2.0f, (i + 21 - 69) / 12.0f),
+                                sysParams);
+        }
+        pedal.setDamper(true);
+
+        for (int i = 0; i < N_VOICES; ++i)
+        {
+            auto& v = voices[i];
+            v.key   = i * 5 % 88;
+            if (COPY)
+            {
+                v.kernel = notes[v.key].getKernel();
+            }
+            v.buffer.resize(notes[v.key].computeAllocatorSize() / 4 + 1);
+            v.state.attachBuffer(v.buffer.data(),
+                                 v.buffer.size() * sizeof(uint32_t));
+            notes[v.key].keyOn(v.state, 5.0f);
+        }
+    }
+
+    const Note::Kernel& getKernel(const Voice& v) const
+    {
+        return COPY ? v.kernel : notes[v.key].getKernel();
+    }
+
+    // n はボイスあたりのサンプル数の合計
+    void run(size_t n)
+    {
+        constexpr size_t BLOCK_SIZE = 128;
+        Note::SampleT samples[BLOCK_SIZE];
+        for (size_t i = 0; i < n; i += BLOCK_SIZE * N_VOICES)
+        {
+            std::fill(std::begin(samples), std::end(samples), 0);
+            for (auto& v : voices)
+            {
+                getKernel(v).update(
+                    samples, BLOCK_SIZE, v.state, sysParams, pedal);
+            }
+            consume(samples[0]);
+        }
+    }
+};
+
+PM_BENCHMARK("voices/shared", [](size_t n) {
+    static VoiceBench<false> bench;
+    bench.run(n);
+});
+PM_BENCHMARK("voices/copied", [](size_t n) {
+    static VoiceBench<true> bench;
+    bench.run(n);
+});
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    const char* filter = argc > 1 ? argv[1] : "";
+
+    // 値は全て 1 サンプルあたり
+    printf("%-40s %10s %10s %10s\n", "benchmark", "ns", "cycles", "L1D miss");
+    for (auto& b : getBenchmarks())
+    {
+        if (!strstr(b.name, filter))
+        {
+            continue;
+        }
+        auto r = measure(b);
+        printf("%-40s %10.2f", b.name, r.ns);
+        for (double v : {r.cycles, r.l1dMisses})
+        {
+            if (v < 0)
+            {
+                printf(" %10s", "-");
+            }
+            else
+            {
+                printf(" %10.2f", v);
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    return 0;
+}
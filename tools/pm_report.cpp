@@ -0,0 +1,1521 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sun Oct 18 2026 21:2:37
+ *
+ * 音源パラメータの検証レポート (host用)
+ *
+ * build:
+ *   g++ -std=c++1z -O2 -Imain -Itools/host tools/pm_report.cpp \
+ *       main/pm_piano/{allocator,convolution_soundboard,filter,hammer,note,\
+ *       note_manager,note_table,piano,real_fft,soundboard,string,\
+ *       sys_params}.cpp \
+ *       main/audio/{output_ring,upsampler}.cpp main/io/midi.cpp \
+ *       main/system/{latency_probe,realtime_monitor,trace}.cpp \
+ *       tools/host/{alloc_counter,nvs,util}.cpp -pthread -o pm_report
+ *
+ * usage:
+ *   ./pm_report [--rate <Hz>] <command> ...
+ *                        --rate でサンプリング周波数を変える
+ *                        (22050, 32000, 44100, 48000、既定は 32000)
+ *   ./pm_report tuning   Thirian / 1次 allpass 調律の音程誤差
+ *   ./pm_report memory   遅延線メモリと同じ予算での同時発音数
+ *   ./pm_report render <file>
+ *                        固定の打鍵列を鳴らした各ノートの出力を書き出す
+ *   ./pm_report snr <reference> <test>
+ *                        render 同士の SNR (遅延線の格納形式の比較用)
+ *   ./pm_report keyon    低音 10 音の和音を弾いたブロックの処理時間
+ *   ./pm_report latency [notes]
+ *                        別スレッドから実時間で MIDI を送ってノートオン遅延と
+ *                        ブロックごとの処理時間を計る
+ *   ./pm_report trace <file> [notes]
+ *                        実時間で弾いた間のトレースを Chrome の JSON で書き出す
+ *   ./pm_report alloc [abort]
+ *                        暖機後の Piano::update でヒープ確保がないことを確かめる
+ *                        (abort なら最初の確保で止める)
+ *   ./pm_report idle     和音を離してから描画を止めるまでの時間と処理時間
+ *   ./pm_report convolution [ir.f32]
+ *                        FDN と畳み込みの soundboard の出力の差と処理時間
+ *                        ir.f32 (float の生データ) を与えればそれを畳み込む
+ *   ./pm_report upsample [beta]
+ *                        内蔵 DAC 用の 4倍補間の像の抑圧と処理時間
+ *                        beta を与えれば FIR の Kaiser 窓をそれにする
+ *   ./pm_report sink     響板の出力を sink で直接変換したときの一致と処理時間
+ *   ./pm_report ring [seconds]
+ *                        描画をときどき止めて出力のリングの prefill と
+ *                        underrun を見る
+ *   ./pm_report notetable [table.bin]
+ *                        Note の係数表の読み込み時間と、計算したものと
+ *                        出力が一致することを確かめる
+ *   ./pm_report notecache
+ *                        起動 1回分の係数表の読み込み (埋め込み -> host の
+ *                        NVS のファイル -> 計算して保存) と出力の一致
+ */
+
+#include <audio/output_ring.h>
+#include <audio/upsampler.h>
+#include <pm_piano/convolution_soundboard.h>
+#include <pm_piano/note.h>
+#include <pm_piano/note_manager.h>
+#include <pm_piano/note_table.h>
+#include <pm_piano/piano.h>
+#include <pm_piano/sys_params.h>
+#include <system/nvs.h>
+#include <system/realtime_monitor.h>
+#include <system/trace.h>
+#include <system/util.h>
+
+#include "host/alloc_counter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+using namespace physical_modeling_piano;
+
+namespace
+{
+
+constexpr int NOTE_BEGIN = 21;
+constexpr int N_NOTES    = 88;
+
+// --rate で変える
+uint32_t sampleRate_ = DEFAULT_SAMPLE_RATE;
+
+SystemParameters
+makeSystemParameters()
+{
+    SystemParameters sysParams;
+    sysParams.setSampleRate(sampleRate_);
+    return sysParams;
+}
+
+float
+getNoteFrequency(int i)
+{
+    return 440 * powf(2.0f, (i + NOTE_BEGIN - 69) / 12.0f);
+}
+
+const char*
+getNoteName(int i, char* buf, size_t size)
+{
+    static const char* names[] = {
+        "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+    int n = i + NOTE_BEGIN;
+    snprintf(buf, size, "%s%d", names[n % 12], n / 12 - 1);
+    return buf;
+}
+
+std::vector<Note>
+makeNotes(const SystemParameters& sysParams)
+{
+    std::vector<Note> notes(N_NOTES);
+    for (int i = 0; i < N_NOTES; ++i)
+    {
+        notes[i].initialize(getNoteFrequency(i), sysParams);
+    }
+    return notes;
+}
+
+// 弦のうち最大の誤差 [cent]
+float
+getMaxPitchError(const Note& note, const SystemParameters& sysParams)
+{
+    float r = 0;
+    for (int i = 0; i < note.getStringCount(); ++i)
+    {
+        float e = note.computePitchError(i, sysParams);
+        r       = fabsf(e) > fabsf(r) ? e : r;
+    }
+    return r;
+}
+
+int
+reportTuning(int, char*[])
+{
+    auto thirianParams         = makeSystemParameters();
+    thirianParams.tuningFilter = TuningFilterType::THIRIAN;
+    auto allpassParams         = makeSystemParameters();
+    allpassParams.tuningFilter = TuningFilterType::ALLPASS1;
+
+    auto thirian = makeNotes(thirianParams);
+    auto allpass = makeNotes(allpassParams);
+
+    printf("%-5s %9s %10s %10s\n", "note", "freq", "thirian", "allpass1");
+
+    float sum2[2]{};
+    float maxAbs[2]{};
+    for (int i = 0; i < N_NOTES; ++i)
+    {
+        float e[2] = {getMaxPitchError(thirian[i], thirianParams),
+                      getMaxPitchError(allpass[i], allpassParams)};
+        for (int j = 0; j < 2; ++j)
+        {
+            sum2[j] += e[j] * e[j];
+            maxAbs[j] = std::max(maxAbs[j], fabsf(e[j]));
+        }
+
+        char name[8];
+        printf("%-5s %9.3f %+10.3f %+10.3f\n",
+               getNoteName(i, name, sizeof(name)),
+               getNoteFrequency(i),
+               e[0],
+               e[1]);
+    }
+
+    printf("\n[cent]  %10s %10s\n", "thirian", "allpass1");
+    printf("rms     %10.3f %10.3f\n",
+           sqrtf(sum2[0] / N_NOTES),
+           sqrtf(sum2[1] / N_NOTES));
+    printf("max     %10.3f %10.3f\n", maxAbs[0], maxAbs[1]);
+    return 0;
+}
+
+// 弦の遅延線バッファの合計 [byte]
+size_t
+computeDelayMemory(const Note& note,
+                   size_t (*bufferSize)(size_t),
+                   size_t sampleSize)
+{
+    size_t s = 0;
+    for (int i = 0; i < note.getStringCount(); ++i)
+    {
+        for (auto d : note.getString(i).getDelayLengths())
+        {
+            s += bufferSize(d) * sampleSize;
+        }
+    }
+    return s;
+}
+
+int
+reportMemory(int, char*[])
+{
+    constexpr size_t N_POLY = 10; // 元の piano_.initialize(10)
+
+    struct Layout
+    {
+        const char* name;
+        size_t (*bufferSize)(size_t);
+        size_t sampleSize;
+    };
+    static const Layout layouts[] = {
+        {"pow2", computeDelayBufferSize, sizeof(int32_t)},
+        {"exact", computeExactDelayBufferSize, sizeof(int32_t)},
+        {"exact16", computeExactDelayBufferSize, sizeof(int16_t)},
+    };
+    constexpr int N_LAYOUTS = sizeof(layouts) / sizeof(layouts[0]);
+
+    auto sysParams = makeSystemParameters();
+    auto notes     = makeNotes(sysParams);
+
+    printf("%-5s %9s", "note", "freq");
+    for (auto& l : layouts)
+    {
+        printf(" %10s", l.name);
+    }
+    printf("\n");
+
+    size_t maxSize[N_LAYOUTS]{};
+    size_t sum[N_LAYOUTS]{};
+    for (int i = 0; i < N_NOTES; ++i)
+    {
+        char name[8];
+        printf("%-5s %9.3f",
+               getNoteName(i, name, sizeof(name)),
+               getNoteFrequency(i));
+        for (int j = 0; j < N_LAYOUTS; ++j)
+        {
+            auto s = computeDelayMemory(
+                notes[i], layouts[j].bufferSize, layouts[j].sampleSize);
+            maxSize[j] = std::max(maxSize[j], s);
+            sum[j] += s;
+            printf(" %10zd", s);
+        }
+        printf("\n");
+    }
+
+    // 1ボイスは Note::State + 最悪ケースの遅延線バッファを持つ
+    size_t voice[N_LAYOUTS];
+    for (int j = 0; j < N_LAYOUTS; ++j)
+    {
+        voice[j] = sizeof(Note::State) + maxSize[j];
+    }
+    size_t budget = N_POLY * voice[0];
+
+    auto printRow = [&](const char* title, auto&& f) {
+        printf("%-16s", title);
+        for (int j = 0; j < N_LAYOUTS; ++j)
+        {
+            printf(" %10zd", f(j));
+        }
+        printf("\n");
+    };
+
+    printf("\n%-16s", "[byte]");
+    for (auto& l : layouts)
+    {
+        printf(" %10s", l.name);
+    }
+    printf("\n");
+    printRow("delay max", [&](int j) { return maxSize[j]; });
+    printRow("delay average", [&](int j) { return sum[j] / N_NOTES; });
+    printRow("voice", [&](int j) { return voice[j]; });
+    printf("%-16s %10zd\n", "budget", budget);
+    printRow("polyphony", [&](int j) { return budget / voice[j]; });
+
+    printf("\ncurrent build: USE_EXACT_DELAY_BUFFER=%d "
+           "USE_COMPRESSED_DELAY_BUFFER=%d, allocator %zd bytes\n",
+           USE_EXACT_DELAY_BUFFER,
+           USE_COMPRESSED_DELAY_BUFFER,
+           std::max_element(notes.begin(),
+                            notes.end(),
+                            [](const Note& a, const Note& b) {
+                                return a.computeAllocatorSize() <
+                                       b.computeAllocatorSize();
+                            })
+               ->computeAllocatorSize());
+    return 0;
+}
+
+////
+// 遅延線の格納形式による劣化の測定用
+// 格納形式を変えてビルドしたもの同士で render の出力を snr で比べる
+
+constexpr int RENDER_KEY_STEP       = 3;
+constexpr float RENDER_VELOCITIES[] = {1.0f, 5.0f, 10.0f};
+constexpr int RENDER_BLOCKS         = 250; // 32kHz で 1秒
+constexpr int RENDER_BLOCK_SIZE     = 128;
+
+constexpr size_t
+getRenderSegmentSize()
+{
+    return RENDER_BLOCKS * RENDER_BLOCK_SIZE;
+}
+
+int
+renderCorpus(int argc, char* argv[])
+{
+    if (argc < 1)
+    {
+        printf("usage: render <out file>\n");
+        return 1;
+    }
+    auto* fp = fopen(argv[0], "wb");
+    if (!fp)
+    {
+        printf("can't open %s\n", argv[0]);
+        return 1;
+    }
+
+    auto sysParams = makeSystemParameters();
+    auto notes     = makeNotes(sysParams);
+
+    PedalState pedal;
+    pedal.setDamper(true);
+
+    std::vector<Note::SampleT> samples(RENDER_BLOCK_SIZE);
+    for (float v : RENDER_VELOCITIES)
+    {
+        for (int i = 0; i < N_NOTES; i += RENDER_KEY_STEP)
+        {
+            std::vector<uint32_t> buffer(notes[i].computeAllocatorSize() / 4 +
+                                         1);
+            Note::State state;
+            state.attachBuffer(buffer.data(),
+                               buffer.size() * sizeof(uint32_t));
+            notes[i].keyOn(state, v);
+
+            for (int b = 0; b < RENDER_BLOCKS; ++b)
+            {
+                std::fill(samples.begin(), samples.end(), 0);
+                notes[i].update(samples.data(),
+                                samples.size(),
+                                state,
+                                sysParams,
+                                pedal);
+                fwrite(samples.data(),
+                       sizeof(Note::SampleT),
+                       samples.size(),
+                       fp);
+            }
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+std::vector<int32_t>
+readRender(const char* filename)
+{
+    std::vector<int32_t> r;
+    if (auto* fp = fopen(filename, "rb"))
+    {
+        int32_t buf[1024];
+        size_t n;
+        while ((n = fread(buf, sizeof(int32_t), 1024, fp)) > 0)
+        {
+            r.insert(r.end(), buf, buf + n);
+        }
+        fclose(fp);
+    }
+    return r;
+}
+
+int
+reportSNR(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("usage: snr <reference> <test>\n");
+        return 1;
+    }
+    auto ref  = readRender(argv[0]);
+    auto test = readRender(argv[1]);
+    if (ref.empty() || ref.size() != test.size())
+    {
+        printf("size mismatch %zd/%zd\n", ref.size(), test.size());
+        return 1;
+    }
+
+    printf("%-5s", "note");
+    for (float v : RENDER_VELOCITIES)
+    {
+        printf("    v=%4.1f", v);
+    }
+    printf("\n");
+
+    constexpr int N_VELOCITIES =
+        sizeof(RENDER_VELOCITIES) / sizeof(RENDER_VELOCITIES[0]);
+    constexpr int N_KEYS =
+        (N_NOTES + RENDER_KEY_STEP - 1) / RENDER_KEY_STEP;
+    const size_t seg = getRenderSegmentSize();
+
+    double minSNR[N_VELOCITIES];
+    double sumSignal[N_VELOCITIES]{};
+    double sumNoise[N_VELOCITIES]{};
+    std::fill(std::begin(minSNR), std::end(minSNR), 1e9);
+
+    for (int k = 0; k < N_KEYS; ++k)
+    {
+        char name[8];
+        printf("%-5s", getNoteName(k * RENDER_KEY_STEP, name, sizeof(name)));
+        for (int j = 0; j < N_VELOCITIES; ++j)
+        {
+            size_t top    = (j * N_KEYS + k) * seg;
+            double signal = 0;
+            double noise  = 0;
+            for (size_t i = top; i < top + seg; ++i)
+            {
+                double e = double(test[i]) - ref[i];
+                signal += double(ref[i]) * ref[i];
+                noise += e * e;
+            }
+            double snr = 10 * log10(signal / std::max(noise, 1.0));
+            minSNR[j]  = std::min(minSNR[j], snr);
+            sumSignal[j] += signal;
+            sumNoise[j] += noise;
+            printf(" %9.2f", snr);
+        }
+        printf("\n");
+    }
+
+    printf("\n[dB] ");
+    for (float v : RENDER_VELOCITIES)
+    {
+        printf("    v=%4.1f", v);
+    }
+    printf("\ntotal");
+    for (int j = 0; j < N_VELOCITIES; ++j)
+    {
+        printf(" %9.2f",
+               10 * log10(sumSignal[j] / std::max(sumNoise[j], 1.0)));
+    }
+    printf("\nmin  ");
+    for (int j = 0; j < N_VELOCITIES; ++j)
+    {
+        printf(" %9.2f", minSNR[j]);
+    }
+    printf("\n");
+    return 0;
+}
+
+// キーオンを含むブロックの処理時間
+// 空いているボイスのメモリは前のノートのもので汚れている状態から始める
+int
+reportKeyOnLatency(int, char*[])
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr size_t N_POLY      = 16;
+    constexpr size_t MEMORY_SIZE = 64 * 1024;
+    constexpr int N_TRIALS       = 200;
+    constexpr int BLOCK_SIZE     = 128;
+    constexpr int CHORD[]        = {21, 24, 28, 31, 33, 36, 40, 43, 45, 48};
+
+    auto sysParams = makeSystemParameters();
+    static NoteManager noteManager;
+    noteManager.initialize(sysParams, N_POLY, MEMORY_SIZE, BLOCK_SIZE);
+
+    PedalState pedal;
+    std::vector<Note::SampleT> samples(BLOCK_SIZE);
+    auto update = [&] {
+        std::fill(samples.begin(), samples.end(), 0);
+        noteManager.update(samples.data(), BLOCK_SIZE, sysParams, pedal);
+    };
+
+    std::vector<double> keyOnTimes;
+    std::vector<double> chordTimes;
+    std::vector<double> blockTimes;
+    for (int t = 0; t < N_TRIALS; ++t)
+    {
+        auto t0 = Clock::now();
+        for (int k : CHORD)
+        {
+            noteManager.keyOn(k, 5.0f);
+        }
+        auto tk = Clock::now();
+        update();
+        auto t1 = Clock::now();
+        keyOnTimes.push_back(
+            std::chrono::duration<double, std::micro>(tk - t0).count());
+        chordTimes.push_back(
+            std::chrono::duration<double, std::micro>(t1 - t0).count());
+
+        for (int i = 0; i < 4; ++i)
+        {
+            auto t0 = Clock::now();
+            update();
+            auto t1 = Clock::now();
+            blockTimes.push_back(
+                std::chrono::duration<double, std::micro>(t1 - t0).count());
+        }
+
+        // 止めて、次の和音まで空のブロックを挟む
+        for (int k : CHORD)
+        {
+            noteManager.keyOff(k);
+        }
+        for (int i = 0; i < 4; ++i)
+        {
+            update();
+        }
+    }
+
+    auto printStat = [](const char* name, std::vector<double>& v) {
+        std::sort(v.begin(), v.end());
+        printf("%-24s %10.1f %10.1f %10.1f\n",
+               name,
+               v[v.size() / 2],
+               v[v.size() * 99 / 100],
+               v.back());
+    };
+
+    printf("\n[us]                         median        p99        max\n");
+    printStat("10 key-on calls", keyOnTimes);
+    printStat("block with 10 key-ons", chordTimes);
+    printStat("block (chord sounding)", blockTimes);
+    printf("block period %.1f us\n", BLOCK_SIZE * 1e6 / sampleRate_);
+    return 0;
+}
+
+constexpr size_t REALTIME_UNIT_SAMPLES = 128;
+
+// soundTask の ΔΣ の代わりに 16bit の PCM にする
+void
+encodePcm(uint16_t* dst, const int32_t* src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        dst[i] = uint16_t(std::min(std::max(src[i] + 32768, 0), 65535));
+    }
+}
+
+class PcmSink : public OutputSink
+{
+    uint16_t* dst_{};
+
+public:
+    void begin(uint16_t* dst) { dst_ = dst; }
+
+    void write(const int32_t* samples, size_t n) override
+    {
+        encodePcm(dst_, samples, n);
+        dst_ += n;
+    }
+};
+
+// soundTask と同じ流れで Piano を実時間で回し、別スレッドから BLE MIDI の
+// 代わりに到着時刻付きのノートオンを nNotes 回送る
+// DMA は 4ブロック分の出力を積んでおくものとして i2s_write の待ちを真似る
+void
+runRealtime(Piano& piano,
+            io::MidiMessageQueue& midiIn,
+            sys::RealtimeMonitor& monitor,
+            int nNotes)
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr size_t UNIT_SAMPLES = REALTIME_UNIT_SAMPLES;
+    constexpr int DMA_BUF_COUNT   = 4;
+
+    monitor.initialize(UNIT_SAMPLES, sampleRate_);
+
+    std::atomic<bool> done{false};
+    std::thread sender([&] {
+        std::mt19937 rng(1);
+        std::uniform_int_distribution<int> interval(5, 40); // [ms]
+        std::uniform_int_distribution<int> key(21, 108);
+        std::uniform_int_distribution<int> velocity(40, 127);
+
+        std::vector<int> sounding;
+        for (int i = 0; i < nNotes; ++i)
+        {
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(interval(rng)));
+
+            // 8音くらい押さえたままにする
+            if (sounding.size() >= 8)
+            {
+                io::MidiMessage off(0x80, sounding.front(), 0);
+                off.timestamp = sys::micros();
+                midiIn.put(off);
+                sounding.erase(sounding.begin());
+            }
+
+            int k = key(rng);
+            io::MidiMessage on(0x90, k, velocity(rng));
+            on.timestamp = sys::micros();
+            midiIn.put(on);
+            sounding.push_back(k);
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        done = true;
+    });
+
+    const auto period =
+        std::chrono::microseconds(UNIT_SAMPLES * 1000000 / sampleRate_);
+    auto playEnd = Clock::now(); // DMA に積んだ出力が鳴り終わる時刻
+    std::vector<int32_t> samples(UNIT_SAMPLES);
+    while (!done)
+    {
+        auto t0 = sys::micros();
+        std::fill(samples.begin(), samples.end(), 0);
+        piano.update(samples.data(), UNIT_SAMPLES, midiIn);
+        auto t1 = sys::micros();
+
+        auto now    = Clock::now();
+        playEnd     = std::max(playEnd, now);
+        auto queued = std::chrono::duration_cast<std::chrono::microseconds>(
+                          playEnd - now)
+                          .count();
+        piano.getLatencyProbe().blockEncoded(
+            sys::micros(), queued * sampleRate_ / 1000000);
+
+        // DMA が一杯の間は待つ
+        auto t2 = sys::micros();
+        playEnd += period;
+        std::this_thread::sleep_until(playEnd - period * DMA_BUF_COUNT);
+        monitor.recordBlock(t1 - t0, 0, sys::micros() - t2);
+    }
+    sender.join();
+}
+
+int
+reportNoteLatency(int argc, char* argv[])
+{
+    const int nNotes = argc > 0 ? atoi(argv[0]) : 300;
+
+    static Piano piano;
+    piano.initialize(16, 64 * 1024, REALTIME_UNIT_SAMPLES, sampleRate_);
+    io::MidiMessageQueue midiIn;
+    midiIn.setActive(true);
+    sys::RealtimeMonitor monitor;
+
+    runRealtime(piano, midiIn, monitor, nNotes);
+
+    monitor.print();
+    printf("midi drop %u\n", unsigned(midiIn.getDropCount()));
+    piano.getLatencyProbe().print();
+    return 0;
+}
+
+// 実時間で弾いた最後の部分のトレースを Chrome の JSON で書き出す
+// chrome://tracing か ui.perfetto.dev で開く
+int
+writeTrace(int argc, char* argv[])
+{
+    if (argc < 1)
+    {
+        printf("usage: trace <file> [notes]\n");
+        return 1;
+    }
+    const int nNotes = argc > 1 ? atoi(argv[1]) : 50;
+
+    static Piano piano;
+    piano.initialize(16, 64 * 1024, REALTIME_UNIT_SAMPLES, sampleRate_);
+    io::MidiMessageQueue midiIn;
+    midiIn.setActive(true);
+    sys::RealtimeMonitor monitor;
+
+    auto& trace = sys::TraceRecorder::instance();
+    trace.initialize(1 << 16);
+    trace.setEnabled(true);
+
+    runRealtime(piano, midiIn, monitor, nNotes);
+
+    auto* fp = fopen(argv[0], "w");
+    if (!fp)
+    {
+        printf("can't open %s\n", argv[0]);
+        return 1;
+    }
+    trace.writeChromeJSON(fp);
+    fclose(fp);
+    return 0;
+}
+
+// 暖機のあと、打鍵・打ち直し・ペダル・ボイスの奪い合いを含む打鍵列を流し、
+// Piano::update (worker タスクを含む) の中で確保があれば失敗にする
+// MIDI を積むのは BLE 側のタスクの仕事なので数えない
+int
+checkAllocationFree(int argc, char* argv[])
+{
+    constexpr size_t UNIT_SAMPLES = 128;
+    constexpr int WARMUP_BLOCKS   = 250;  // 1秒
+    constexpr int TEST_BLOCKS     = 7500; // 30秒
+
+    bool abortOnAlloc = argc > 0 && strcmp(argv[0], "abort") == 0;
+
+    static Piano piano;
+    piano.initialize(16, 64 * 1024, UNIT_SAMPLES, sampleRate_);
+    io::MidiMessageQueue midiIn;
+    midiIn.setActive(true);
+
+    std::mt19937 rng(2);
+    std::uniform_int_distribution<int> key(21, 108);
+    std::uniform_int_distribution<int> velocity(1, 127);
+    std::uniform_int_distribution<int> action(0, 15);
+
+    std::vector<uint16_t> pcm(UNIT_SAMPLES);
+    PcmSink sink;
+    std::vector<int> sounding;
+    sounding.reserve(128);
+    bool damper = false;
+
+    auto putEvents = [&] {
+        auto put = [&](uint8_t d0, uint8_t d1, uint8_t d2) {
+            io::MidiMessage m(d0, d1, d2);
+            m.timestamp = sys::micros();
+            midiIn.put(m);
+        };
+
+        int a = action(rng);
+        if (a < 4)
+        {
+            int k = a == 0 && !sounding.empty() ? sounding.back() : key(rng);
+            put(0x90, k, velocity(rng));
+            sounding.push_back(k);
+        }
+        else if (a < 6 && !sounding.empty())
+        {
+            put(0x80, sounding.front(), 0);
+            sounding.erase(sounding.begin());
+        }
+        else if (a == 6)
+        {
+            damper = !damper;
+            put(0xb0, 64, damper ? 127 : 0);
+        }
+        if (sounding.size() > 24)
+        {
+            sounding.erase(sounding.begin());
+        }
+    };
+
+    auto runBlock = [&] {
+        sink.begin(pcm.data());
+        piano.update(sink, UNIT_SAMPLES, midiIn);
+        piano.getLatencyProbe().blockEncoded(sys::micros(), 0);
+    };
+
+    for (int i = 0; i < WARMUP_BLOCKS; ++i)
+    {
+        putEvents();
+        runBlock();
+    }
+
+    host::resetAllocationCount();
+    for (int i = 0; i < TEST_BLOCKS; ++i)
+    {
+        putEvents();
+        host::setAllocationCounting(true, abortOnAlloc);
+        runBlock();
+        host::setAllocationCounting(false);
+    }
+
+    auto n = host::getAllocationCount();
+    printf("allocations in %d blocks after warm-up: %u\n",
+           TEST_BLOCKS,
+           unsigned(n));
+    return n ? 1 : 0;
+}
+
+// 和音を離してから全ボイスが止まり、響板の残響が消えて idle になるまで
+int
+reportIdle(int, char*[])
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr size_t UNIT_SAMPLES = REALTIME_UNIT_SAMPLES;
+    constexpr int CHORD[]         = {36, 48, 55, 60, 64, 67};
+    constexpr int HOLD_BLOCKS     = 250;
+    constexpr int MAX_BLOCKS      = 100000;
+    constexpr int IDLE_BLOCKS     = 10000;
+
+    static Piano piano;
+    piano.initialize(16, 64 * 1024, UNIT_SAMPLES, sampleRate_);
+    io::MidiMessageQueue midiIn;
+    midiIn.setActive(true);
+    std::vector<int32_t> samples(UNIT_SAMPLES);
+
+    enum Phase
+    {
+        VOICES, // ボイスが鳴っている
+        TAIL,   // 響板の残響だけ
+        IDLE,
+        N_PHASES,
+    };
+    static const char* phaseNames[] = {"voices", "tail", "idle"};
+    double time[N_PHASES]{};
+    int count[N_PHASES]{};
+    std::vector<int32_t> peaks; // ブロックごとの出力の最大値
+
+    int releaseBlock = -1;
+    int voicesEnd    = -1;
+    int idleBlock    = -1;
+    for (int b = 0; b < MAX_BLOCKS; ++b)
+    {
+        if (b == 0 || b == HOLD_BLOCKS)
+        {
+            for (int k : CHORD)
+            {
+                midiIn.put(io::MidiMessage(b ? 0x80 : 0x90, k, 100));
+            }
+            releaseBlock = HOLD_BLOCKS;
+        }
+
+        Phase phase = piano.getCurrentNoteCount() ? VOICES : TAIL;
+        std::fill(samples.begin(), samples.end(), 0);
+        auto t0       = Clock::now();
+        bool sounding = piano.update(samples.data(), UNIT_SAMPLES, midiIn);
+        auto t1       = Clock::now();
+        if (!sounding)
+        {
+            phase = IDLE;
+        }
+        time[phase] +=
+            std::chrono::duration<double, std::micro>(t1 - t0).count();
+        ++count[phase];
+
+        if (b > releaseBlock && voicesEnd < 0 && phase != VOICES)
+        {
+            voicesEnd = b;
+        }
+        if (phase == IDLE && b > releaseBlock)
+        {
+            idleBlock = b;
+            break;
+        }
+
+        int32_t peak = 0;
+        for (auto v : samples)
+        {
+            peak = std::max(peak, std::abs(v));
+        }
+        peaks.push_back(peak);
+    }
+    if (idleBlock < 0)
+    {
+        printf("did not become idle in %d blocks\n", MAX_BLOCKS);
+        return 1;
+    }
+
+    for (int i = 0; i < IDLE_BLOCKS; ++i)
+    {
+        auto t0 = Clock::now();
+        piano.update(samples.data(), UNIT_SAMPLES, midiIn);
+        auto t1 = Clock::now();
+        time[IDLE] +=
+            std::chrono::duration<double, std::micro>(t1 - t0).count();
+        ++count[IDLE];
+    }
+
+    auto toSec = [](int blocks) {
+        return float(blocks) * UNIT_SAMPLES / sampleRate_;
+    };
+    printf("release -> voices stopped %6.2f s\n",
+           toSec(voicesEnd - releaseBlock));
+    printf("release -> idle           %6.2f s\n",
+           toSec(idleBlock - releaseBlock));
+    // idle の直前 100ms
+    const int nLast = int(sampleRate_ / 10 / UNIT_SAMPLES);
+    auto lastPeak   = *std::max_element(peaks.end() - nLast, peaks.end());
+    printf("peak |output| in the last 100 ms: %d LSB\n", int(lastPeak));
+    printf("phase      blocks   mean [us]\n");
+    for (int i = 0; i < N_PHASES; ++i)
+    {
+        printf("%-8s %8d %11.2f\n",
+               phaseNames[i],
+               count[i],
+               count[i] ? time[i] / count[i] : 0.0);
+    }
+    return 0;
+}
+
+// 数音の和音を響板に通し、FDN と (そのインパルス応答の) 畳み込みを比べる
+int
+reportConvolution(int argc, char* argv[])
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr int CHORD[]     = {12, 27, 39, 46, 51, 63, 75};
+    constexpr int N_BLOCKS    = 1000; // 4 sec
+    constexpr size_t BLOCKS[] = {64, 128, 256};
+    constexpr size_t MAX_BLOCK = 256;
+
+    auto sysParams = makeSystemParameters();
+    auto notes     = makeNotes(sysParams);
+
+    // 響板への入力 (NoteManager の出力と同じもの)
+    PedalState pedal;
+    pedal.setDamper(true);
+    std::vector<std::vector<uint32_t>> buffers;
+    std::vector<Note::State> states(sizeof(CHORD) / sizeof(CHORD[0]));
+    for (size_t i = 0; i < states.size(); ++i)
+    {
+        auto& note = notes[CHORD[i]];
+        buffers.emplace_back(note.computeAllocatorSize() / 4 + 1);
+        states[i].attachBuffer(buffers.back().data(),
+                               buffers.back().size() * sizeof(uint32_t));
+        note.keyOn(states[i], 5.0f);
+    }
+    const size_t total = N_BLOCKS * MAX_BLOCK;
+    std::vector<Note::SampleT> input(total);
+    for (size_t b = 0; b < total; b += MAX_BLOCK)
+    {
+        for (size_t i = 0; i < states.size(); ++i)
+        {
+            notes[CHORD[i]].update(
+                &input[b], MAX_BLOCK, states[i], sysParams, pedal);
+        }
+    }
+    const auto* src =
+        reinterpret_cast<const SoundboardTypes::ValueT*>(input.data());
+
+    std::vector<float> ir;
+    if (argc > 0)
+    {
+        auto* fp = fopen(argv[0], "rb");
+        if (!fp)
+        {
+            printf("can't open %s\n", argv[0]);
+            return 1;
+        }
+        float buf[1024];
+        size_t n;
+        while ((n = fread(buf, sizeof(float), 1024, fp)) > 0)
+        {
+            ir.insert(ir.end(), buf, buf + n);
+        }
+        fclose(fp);
+    }
+
+    std::vector<SoundboardTypes::ResultT> fdnOut(total);
+    std::vector<SoundboardTypes::ResultT> convOut(total);
+    printf("block   fdn [us]  conv [us]  partitions\n");
+    for (size_t blockSize : BLOCKS)
+    {
+        static Soundboard fdn;
+        static ConvolutionSoundboard conv;
+        fdn.initialize(sysParams);
+        conv.initialize(sysParams, blockSize);
+        if (!ir.empty())
+        {
+            conv.setImpulseResponse(ir.data(), ir.size());
+        }
+
+        double fdnTime  = 0;
+        double convTime = 0;
+        for (size_t b = 0; b < total; b += blockSize)
+        {
+            auto t0 = Clock::now();
+            fdn.update(&fdnOut[b], src + b, blockSize);
+            auto t1 = Clock::now();
+            conv.update(&convOut[b], src + b, blockSize);
+            auto t2 = Clock::now();
+            fdnTime +=
+                std::chrono::duration<double, std::micro>(t1 - t0).count();
+            convTime +=
+                std::chrono::duration<double, std::micro>(t2 - t1).count();
+        }
+        const double nBlocks = double(total / blockSize);
+        printf("%5zd %10.2f %10.2f %11zd\n",
+               blockSize,
+               fdnTime / nBlocks,
+               convTime / nBlocks,
+               conv.getPartitionCount());
+    }
+
+    double signal = 0;
+    double noise  = 0;
+    for (size_t i = 0; i < total; ++i)
+    {
+        double r = float(fdnOut[i]);
+        double e = float(convOut[i]) - r;
+        signal += r * r;
+        noise += e * e;
+    }
+    printf("conv vs fdn: %.2f dB (ir %zd samples)\n",
+           10 * log10(signal / std::max(noise, 1e-30)),
+           ir.empty() ? size_t(ConvolutionSoundboard::DEFAULT_IR_SECONDS *
+                               sysParams.sampleRate)
+                      : ir.size());
+    return 0;
+}
+
+// samples に書いてから PCM にする (以前の soundTask) のと
+// sink で響板の出力を直接 PCM にするのを同じ打鍵で比べる
+int
+reportSink(int, char*[])
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr size_t UNIT_SAMPLES = REALTIME_UNIT_SAMPLES;
+    constexpr int CHORD[]         = {36, 48, 55, 60, 64, 67, 72};
+    constexpr int N_BLOCKS        = 2500; // 10秒
+    constexpr int RELEASE_BLOCK   = 1000;
+
+    static Piano buffered;
+    static Piano fused;
+    buffered.initialize(16, 64 * 1024, UNIT_SAMPLES, sampleRate_);
+    fused.initialize(16, 64 * 1024, UNIT_SAMPLES, sampleRate_);
+    io::MidiMessageQueue midiIn[2];
+    for (auto& m : midiIn)
+    {
+        m.setActive(true);
+    }
+
+    std::vector<int32_t> samples(UNIT_SAMPLES);
+    std::vector<uint16_t> pcm[2] = {std::vector<uint16_t>(UNIT_SAMPLES),
+                                    std::vector<uint16_t>(UNIT_SAMPLES)};
+    PcmSink sink;
+
+    double time[2]{};
+    int blocks    = 0;
+    size_t differ = 0;
+    for (int b = 0; b < N_BLOCKS; ++b)
+    {
+        if (b == 0 || b == RELEASE_BLOCK)
+        {
+            for (auto& m : midiIn)
+            {
+                for (int k : CHORD)
+                {
+                    m.put(io::MidiMessage(b ? 0x80 : 0x90, k, 100));
+                }
+            }
+        }
+
+        auto t0 = Clock::now();
+        bool s0 = buffered.update(samples.data(), UNIT_SAMPLES, midiIn[0]);
+        if (s0)
+        {
+            encodePcm(pcm[0].data(), samples.data(), UNIT_SAMPLES);
+        }
+        auto t1 = Clock::now();
+        sink.begin(pcm[1].data());
+        bool s1 = fused.update(sink, UNIT_SAMPLES, midiIn[1]);
+        auto t2 = Clock::now();
+
+        if (s0 != s1)
+        {
+            printf("block %d: sounding differs\n", b);
+            return 1;
+        }
+        if (!s0)
+        {
+            continue;
+        }
+        time[0] += std::chrono::duration<double, std::micro>(t1 - t0).count();
+        time[1] += std::chrono::duration<double, std::micro>(t2 - t1).count();
+        ++blocks;
+        for (size_t i = 0; i < UNIT_SAMPLES; ++i)
+        {
+            differ += pcm[0][i] != pcm[1][i];
+        }
+    }
+
+    printf("sounding blocks %d, differing samples %zd\n", blocks, differ);
+    printf("buffered  %8.2f us/block\n", time[0] / blocks);
+    printf("sink      %8.2f us/block\n", time[1] / blocks);
+    return differ ? 1 : 0;
+}
+
+// 2つの Piano で全鍵を順に弾いて出力が一致しなかったサンプル数を返す
+// 鳴っているかどうかが違えば -1
+long
+comparePianoKeys(Piano& reference, Piano& test)
+{
+    constexpr size_t UNIT_SAMPLES = REALTIME_UNIT_SAMPLES;
+    constexpr int KEY_BLOCKS      = 10; // 1鍵あたり
+    constexpr int N_BLOCKS        = N_NOTES * KEY_BLOCKS + 500;
+
+    io::MidiMessageQueue midiIn[2];
+    for (auto& m : midiIn)
+    {
+        m.setActive(true);
+    }
+
+    std::vector<int32_t> samples[2] = {std::vector<int32_t>(UNIT_SAMPLES),
+                                       std::vector<int32_t>(UNIT_SAMPLES)};
+    long differ = 0;
+    for (int b = 0; b < N_BLOCKS; ++b)
+    {
+        int key = b / KEY_BLOCKS;
+        if (b % KEY_BLOCKS == 0 && key < N_NOTES)
+        {
+            for (auto& m : midiIn)
+            {
+                if (key)
+                {
+                    m.put(io::MidiMessage(0x80, NOTE_BEGIN + key - 1, 0));
+                }
+                m.put(io::MidiMessage(0x90, NOTE_BEGIN + key, 100));
+            }
+        }
+
+        bool s[2];
+        for (int i = 0; i < 2; ++i)
+        {
+            std::fill(samples[i].begin(), samples[i].end(), 0);
+            s[i] = (i ? test : reference)
+                       .update(samples[i].data(), UNIT_SAMPLES, midiIn[i]);
+        }
+        if (s[0] != s[1])
+        {
+            printf("block %d: sounding differs\n", b);
+            return -1;
+        }
+        for (size_t i = 0; i < UNIT_SAMPLES; ++i)
+        {
+            differ += samples[0][i] != samples[1][i];
+        }
+    }
+    return differ;
+}
+
+// 計算した Note と係数表から読んだ Note で全鍵を順に弾いて出力を比べる
+// table.bin (gen_note_table の出力) を与えなければその場で表を作る
+int
+reportNoteTable(int argc, char* argv[])
+{
+    using Clock = std::chrono::steady_clock;
+    using us    = std::chrono::duration<double, std::micro>;
+
+    constexpr size_t UNIT_SAMPLES = REALTIME_UNIT_SAMPLES;
+
+    auto sysParams = makeSystemParameters();
+    std::vector<uint8_t> table;
+    if (argc > 0)
+    {
+        auto* fp = fopen(argv[0], "rb");
+        if (!fp)
+        {
+            printf("can't open %s\n", argv[0]);
+            return 1;
+        }
+        int c;
+        while ((c = fgetc(fp)) != EOF)
+        {
+            table.push_back(uint8_t(c));
+        }
+        fclose(fp);
+    }
+    else
+    {
+        std::vector<Note> notes(N_NOTES);
+        computeNotes(notes.data(), N_NOTES, NOTE_BEGIN, sysParams);
+        table = saveNoteTable(notes.data(), N_NOTES, sysParams);
+    }
+    const size_t tableBytes = table.size();
+
+    std::vector<Note> notes(N_NOTES);
+    auto t0 = Clock::now();
+    computeNotes(notes.data(), N_NOTES, NOTE_BEGIN, sysParams);
+    auto t1     = Clock::now();
+    bool loaded = loadNoteTable(
+        notes.data(), N_NOTES, sysParams, table.data(), tableBytes);
+    auto t2      = Clock::now();
+    uint32_t key = 0;
+    if (tableBytes >= 8)
+    {
+        memcpy(&key, table.data() + 4, sizeof(key)); // host は little endian
+    }
+    printf("table %zd bytes, key %08x (expected %08x)\n",
+           tableBytes,
+           unsigned(key),
+           unsigned(computeNoteTableKey(sysParams)));
+    printf("compute %8.1f us\n", us(t1 - t0).count());
+    printf("load    %8.1f us%s\n",
+           us(t2 - t1).count(),
+           loaded ? "" : " (failed)");
+    if (!loaded)
+    {
+        return 1;
+    }
+
+    static Piano computed;
+    static Piano fromTable;
+    computed.initialize(16, 64 * 1024, UNIT_SAMPLES, sampleRate_);
+    fromTable.setNoteTable(table.data(), tableBytes);
+    fromTable.initialize(16, 64 * 1024, UNIT_SAMPLES, sampleRate_);
+
+    auto differ = comparePianoKeys(computed, fromTable);
+    printf("%d keys, differing samples %ld\n", N_NOTES, differ);
+    return differ ? 1 : 0;
+}
+
+// 本体の NVS の代わりに host のファイルに係数表を置く
+// 読み書きの回数を数える
+class HostNoteTableStorage : public NoteTableStorage
+{
+public:
+    int loads{};
+    int saves{};
+    size_t size{};
+
+    bool load(std::vector<uint8_t>& table) override
+    {
+        ++loads;
+        return sys::readNVSBlob("pm_piano", "note_table", table);
+    }
+
+    bool save(const std::vector<uint8_t>& table) override
+    {
+        ++saves;
+        size = table.size();
+        return sys::writeNVSBlob(
+            "pm_piano", "note_table", table.data(), table.size());
+    }
+};
+
+// 起動 1回分: 埋め込みの表 (既定の周波数) と host の NVS の表で初期化し
+// 表を使ったか計算して置き直したかと、計算したものと出力が一致するかを見る
+// --rate を変えて繰り返すと合わない表を計算し直して上書きする
+int
+reportNoteCache(int, char*[])
+{
+    constexpr size_t UNIT_SAMPLES = REALTIME_UNIT_SAMPLES;
+
+    auto defaultParams = makeSystemParameters();
+    defaultParams.setSampleRate(DEFAULT_SAMPLE_RATE);
+    std::vector<Note> notes(N_NOTES);
+    computeNotes(notes.data(), N_NOTES, NOTE_BEGIN, defaultParams);
+    auto embedded = saveNoteTable(notes.data(), N_NOTES, defaultParams);
+
+    HostNoteTableStorage storage;
+    static Piano computed;
+    static Piano cached;
+    computed.initialize(16, 64 * 1024, UNIT_SAMPLES, sampleRate_);
+    cached.setNoteTable(embedded.data(), embedded.size());
+    cached.setNoteTableStorage(&storage);
+    cached.initialize(16, 64 * 1024, UNIT_SAMPLES, sampleRate_);
+    printf("storage: %d loads, %d saves", storage.loads, storage.saves);
+    if (storage.saves)
+    {
+        printf(" (%zd bytes)", storage.size);
+    }
+    printf("\n");
+
+    auto differ = comparePianoKeys(computed, cached);
+    printf("%d keys, differing samples %ld\n", N_NOTES, differ);
+    return differ ? 1 : 0;
+}
+
+// 描画と出力を別スレッドにしてリングでつなぎ、ときどき描画を止めて
+// (BLE の割り込みや重いキーオンの代わり) prefill の増減と underrun を見る
+// 出力側は DMA の代わりに 1 ブロックの周期ごとに 1 ブロック取り出す
+int
+reportOutputRing(int argc, char* argv[])
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr size_t UNIT_SAMPLES = REALTIME_UNIT_SAMPLES;
+    constexpr int DEPTH           = 8;
+    constexpr uint32_t SHRINK     = 1000; // 4秒
+    constexpr int CHORD[]         = {36, 48, 55, 60, 64, 67};
+
+    const float seconds = argc > 0 ? float(atof(argv[0])) : 30.0f;
+    const int nBlocks   = int(seconds * sampleRate_ / UNIT_SAMPLES);
+    const auto period =
+        std::chrono::microseconds(UNIT_SAMPLES * 1000000 / sampleRate_);
+
+    static Piano piano;
+    piano.initialize(16, 64 * 1024, UNIT_SAMPLES, sampleRate_);
+    io::MidiMessageQueue midiIn;
+    midiIn.setActive(true);
+
+    static audio::OutputRing ring;
+    ring.initialize(UNIT_SAMPLES * sizeof(uint16_t), DEPTH, 1, SHRINK);
+
+    std::atomic<bool> done{false};
+    std::atomic<bool> renderDone{false};
+    double prefillSum = 0;
+    std::thread output([&] {
+        auto next   = Clock::now();
+        int prefill = ring.getStats().prefill;
+        for (int b = 0; b < nBlocks; ++b)
+        {
+            prefillSum += prefill;
+            auto* p = ring.beginRead(pdMS_TO_TICKS(8));
+            next += period;
+            std::this_thread::sleep_until(next);
+            if (p)
+            {
+                ring.endRead();
+            }
+
+            auto s = ring.getStats();
+            if (s.prefill != prefill)
+            {
+                printf("%6.2f s  prefill %d -> %d\n",
+                       b * UNIT_SAMPLES / float(sampleRate_),
+                       prefill,
+                       s.prefill);
+                prefill = s.prefill;
+            }
+        }
+        // 描画側が beginWrite で待っていれば抜けるまで進める
+        done = true;
+        while (!renderDone)
+        {
+            if (ring.beginRead(1))
+            {
+                ring.endRead();
+            }
+        }
+    });
+
+    // 平均 1秒に 1回、2-15ms 止める
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> spikeChance(0, 249);
+    std::uniform_int_distribution<int> spikeMs(2, 15);
+    int spikes = 0;
+
+    PcmSink sink;
+    for (int b = 0; !done; ++b)
+    {
+        auto* out = static_cast<uint16_t*>(ring.beginWrite());
+        if (done)
+        {
+            break;
+        }
+        if (b % 250 == 0)
+        {
+            for (int k : CHORD)
+            {
+                midiIn.put(io::MidiMessage(0x90, k, 100));
+            }
+        }
+        sink.begin(out);
+        if (!piano.update(sink, UNIT_SAMPLES, midiIn))
+        {
+            std::fill(out, out + UNIT_SAMPLES, 32768);
+        }
+        if (spikeChance(rng) == 0)
+        {
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(spikeMs(rng)));
+            ++spikes;
+        }
+        ring.endWrite();
+    }
+    renderDone = true;
+    output.join();
+
+    const double meanPrefill = prefillSum / nBlocks;
+    printf("render stalls %d, mean prefill %.2f blocks (%.1f ms)\n",
+           spikes,
+           meanPrefill,
+           meanPrefill * period.count() / 1000);
+    ring.print();
+    return 0;
+}
+
+// 正弦波の振幅 (n が周期の整数倍になる周波数で使う)
+double
+measureTone(const std::vector<int32_t>& x, double freq, double sampleRate)
+{
+    double w  = 2 * M_PI * freq / sampleRate;
+    double c  = 2 * cos(w);
+    double s1 = 0;
+    double s2 = 0;
+    for (auto v : x)
+    {
+        double s = v + c * s1 - s2;
+        s2       = s1;
+        s1       = s;
+    }
+    double re = s1 - s2 * cos(w);
+    double im = s2 * sin(w);
+    return sqrt(re * re + im * im) * 2 / x.size();
+}
+
+// 内蔵 DAC 用の 4倍補間の像の抑圧と処理時間
+// 正弦波を 1秒通して、元の周波数 f と像 (fs-f, fs+f, 2fs-f) の大きさを比べる
+template <class Upsampler>
+void
+reportUpsampler(const char* name, Upsampler& upsampler)
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr int FREQS[]      = {1000, 2000, 4000, 6000, 8000, 10000, 12000};
+    constexpr size_t BLOCK     = REALTIME_UNIT_SAMPLES;
+    constexpr int FACTOR       = audio::UPSAMPLE_FACTOR;
+    const int fs               = sampleRate_;
+    constexpr double AMPLITUDE = 16000;
+
+    const size_t warmUp = BLOCK * 2;
+    const size_t n      = fs + warmUp;
+    std::vector<int32_t> in(n);
+    std::vector<int32_t> out(n * FACTOR);
+
+    double time = 0;
+    printf("%-10s", name);
+    for (int f : FREQS)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            in[i] = int32_t(lrint(AMPLITUDE * sin(2 * M_PI * f * i / fs)));
+        }
+        upsampler.clear();
+        auto t0 = Clock::now();
+        for (size_t i = 0; i < n; i += BLOCK)
+        {
+            upsampler.process(&out[i * FACTOR], &in[i], BLOCK);
+        }
+        auto t1 = Clock::now();
+        time += std::chrono::duration<double, std::nano>(t1 - t0).count();
+
+        std::vector<int32_t> x(out.begin() + warmUp * FACTOR, out.end());
+        const double fo = fs * FACTOR;
+        double signal   = measureTone(x, f, fo);
+        double image    = 0;
+        for (int g : {fs - f, fs + f, 2 * fs - f})
+        {
+            image = std::max(image, measureTone(x, g, fo));
+        }
+        printf(" %6.1f", 20 * log10(image / signal));
+    }
+    printf(" %8.2f\n", time / (n * (sizeof(FREQS) / sizeof(FREQS[0]))));
+}
+
+int
+reportUpsample(int argc, char* argv[])
+{
+    const float beta = argc > 0 ? float(atof(argv[0])) : 0;
+
+    printf("image [dBc]\n%-10s", "f [Hz]");
+    for (int f : {1000, 2000, 4000, 6000, 8000, 10000, 12000})
+    {
+        printf(" %6d", f);
+    }
+    printf(" %8s\n", "ns/in");
+
+    static audio::LinearUpsampler linear;
+    linear.initialize(REALTIME_UNIT_SAMPLES);
+    reportUpsampler("linear", linear);
+
+    static audio::PolyphaseUpsampler<4> fir4;
+    static audio::PolyphaseUpsampler<8> fir8;
+    static audio::PolyphaseUpsampler<16> fir16;
+    if (beta > 0)
+    {
+        fir4.initialize(REALTIME_UNIT_SAMPLES, beta);
+        fir8.initialize(REALTIME_UNIT_SAMPLES, beta);
+        fir16.initialize(REALTIME_UNIT_SAMPLES, beta);
+    }
+    else
+    {
+        fir4.initialize(REALTIME_UNIT_SAMPLES);
+        fir8.initialize(REALTIME_UNIT_SAMPLES);
+        fir16.initialize(REALTIME_UNIT_SAMPLES);
+    }
+    reportUpsampler("fir/T=4", fir4);
+    reportUpsampler("fir/T=8", fir8);
+    reportUpsampler("fir/T=16", fir16);
+    return 0;
+}
+
+struct Command
+{
+    const char* name;
+    int (*func)(int argc, char* argv[]);
+};
+
+const Command commands_[] = {
+    {"tuning", reportTuning},
+    {"memory", reportMemory},
+    {"render", renderCorpus},
+    {"snr", reportSNR},
+    {"keyon", reportKeyOnLatency},
+    {"latency", reportNoteLatency},
+    {"alloc", checkAllocationFree},
+    {"trace", writeTrace},
+    {"idle", reportIdle},
+    {"convolution", reportConvolution},
+    {"upsample", reportUpsample},
+    {"sink", reportSink},
+    {"ring", reportOutputRing},
+    {"notetable", reportNoteTable},
+    {"notecache", reportNoteCache},
+};
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    int a = 1;
+    if (argc > 2 && strcmp(argv[1], "--rate") == 0)
+    {
+        sampleRate_ = atoi(argv[2]);
+        if (findSampleRate(sampleRate_) < 0)
+        {
+            printf("unsupported sample rate %s\n", argv[2]);
+            return 1;
+        }
+        a += 2;
+    }
+
+    for (auto& c : commands_)
+    {
+        if (argc > a && strcmp(argv[a], c.name) == 0)
+        {
+            return c.func(argc - a - 1, argv + a + 1);
+        }
+    }
+
+    printf("usage: %s [--rate <Hz>] <command>\n", argv[0]);
+    for (auto& c : commands_)
+    {
+        printf("  %s\n", c.name);
+    }
+    return 1;
+}
@@ -0,0 +1,486 @@
+/*
+ * author : Shuichi TAKANO
+ * since  : Sun Oct 18 2026 20:31:12
+ *
+ * FixedPoint の Q フォーマット調整ツール (host用)
+ *
+ * 計測用 FixedPoint (PM_PIANO_FIXED_PROFILE) でストレス用の演奏を鳴らし、
+ * 型ごとの値域と丸め誤差から安全な最大シフト量を求めて header を生成する。
+ *
+ * build:
+ *   g++ -std=c++1z -O2 -DPM_PIANO_FIXED_PROFILE=1 -Imain \
+ *       tools/qformat_tune.cpp main/pm_piano/{allocator,filter,hammer,note,\
+ *       soundboard,string,sys_params}.cpp -o qformat_tune
+ *
+ * usage:
+ *   ./qformat_tune [output header (default: qformat_tuned.h)] [guard bits]
+ */
+
+#include <pm_piano/note.h>
+#include <pm_piano/soundboard.h>
+#include <pm_piano/sys_params.h>
+
+#include <map>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#if !PM_PIANO_FIXED_PROFILE
+#error "build with -DPM_PIANO_FIXED_PROFILE=1"
+#endif
+
+using namespace physical_modeling_piano;
+
+namespace
+{
+
+constexpr int NOTE_BEGIN      = 21;
+constexpr size_t N_NOTES      = 88;
+constexpr size_t UNIT_SAMPLES = 128;
+
+template <class T>
+struct FixedPointTraits;
+
+template <class T, int S>
+struct FixedPointTraits<FixedPoint<T, S>>
+{
+    static constexpr int bits      = sizeof(T) * 8;
+    static constexpr bool isSigned = std::is_signed<T>::value;
+    static constexpr int shift     = S;
+};
+
+struct TypedefEntry
+{
+    const char* owner;
+    const char* name;
+    int bits;
+    bool isSigned;
+    int shift;
+};
+
+template <class T>
+TypedefEntry
+makeEntry(const char* owner, const char* name)
+{
+    using Tr = FixedPointTraits<T>;
+    return {owner, name, Tr::bits, Tr::isSigned, Tr::shift};
+}
+
+#define TYPEDEF_ENTRY(owner, name) makeEntry<owner::name>(#owner, #name)
+
+const std::vector<TypedefEntry>&
+getTypedefs()
+{
+    static const std::vector<TypedefEntry> entries = {
+        TYPEDEF_ENTRY(String, BridgeSampleT),
+        TYPEDEF_ENTRY(String, StringSampleT),
+        TYPEDEF_ENTRY(String, FilterSampleT),
+        TYPEDEF_ENTRY(String, FilterConstT),
+        TYPEDEF_ENTRY(String, FilterHistoryT),
+        TYPEDEF_ENTRY(String, ImpedanceRatioT),
+        TYPEDEF_ENTRY(Hammer, ResultT),
+        TYPEDEF_ENTRY(Hammer, FeltCompT),
+        TYPEDEF_ENTRY(Hammer, StiffExpT),
+        TYPEDEF_ENTRY(Hammer, C1T),
+        TYPEDEF_ENTRY(Hammer, C2T),
+        TYPEDEF_ENTRY(Hammer, C3T),
+        TYPEDEF_ENTRY(Hammer, LogSpaceT),
+        TYPEDEF_ENTRY(Soundboard, ValueT),
+        TYPEDEF_ENTRY(Soundboard, FilterHistoryT),
+        TYPEDEF_ENTRY(Soundboard, CoefT),
+        TYPEDEF_ENTRY(Soundboard, ResultT),
+        TYPEDEF_ENTRY(Soundboard, ScaleT),
+        TYPEDEF_ENTRY(SystemParameters, DeltaTimeT),
+    };
+    return entries;
+}
+
+const char*
+getTypeName(int bits, bool isSigned)
+{
+    switch (bits)
+    {
+    case 8:
+        return isSigned ? "int8_t" : "uint8_t";
+    case 16:
+        return isSigned ? "int16_t" : "uint16_t";
+    case 32:
+        return isSigned ? "int32_t" : "uint32_t";
+    default:
+        return isSigned ? "int64_t" : "uint64_t";
+    }
+}
+
+////
+
+struct Corpus
+{
+    SystemParameters sysParams;
+    std::vector<Note> notes;
+    Soundboard soundboard;
+    PedalState pedal;
+
+    std::vector<Note::SampleT> mix;
+    std::vector<Soundboard::ResultT> out;
+
+public:
+    void initialize()
+    {
+        notes.resize(N_NOTES);
+        for (size_t i = 0; i < N_NOTES; ++i)
+        {
+            float f = 440 * powf(2.0f, (int(i) + NOTE_BEGIN - 69) / 12.0f);
+            notes[i].initialize(f, sysParams);
+        }
+        soundboard.initialize(sysParams);
+        pedal.setDamper(true); // keyOff 後も減衰させずに鳴らし続ける
+
+        mix.resize(UNIT_SAMPLES);
+        out.resize(UNIT_SAMPLES);
+    }
+
+    // keys を同時に鳴らして soundboard まで通す
+    void render(const std::vector<int>& keys, float v, float sec)
+    {
+        std::vector<Note::State> states(keys.size());
+        std::vector<std::vector<uint32_t>> buffers(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            const auto& note = notes[keys[i]];
+            buffers[i].resize(note.computeAllocatorSize() / 4 + 1);
+            states[i].attachBuffer(buffers[i].data(),
+                                   buffers[i].size() * sizeof(uint32_t));
+            note.keyOn(states[i], v);
+        }
+
+        size_t nBlocks = size_t(sec * sysParams.sampleRate) / UNIT_SAMPLES;
+        for (size_t b = 0; b < nBlocks; ++b)
+        {
+            std::fill(mix.begin(), mix.end(), 0);
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                notes[keys[i]].update(
+                    mix.data(), UNIT_SAMPLES, states[i], sysParams, pedal);
+            }
+            soundboard.update(out.data(), mix.data(), UNIT_SAMPLES);
+        }
+    }
+};
+
+void
+renderStressCorpus()
+{
+    Corpus corpus;
+    corpus.initialize();
+
+    // 全鍵を弱/中/最強打で単音
+    const float velocities[] = {10 / 127.0f, 5.0f, 10.0f};
+    for (auto v : velocities)
+    {
+        printf("single notes v=%g\n", v);
+        for (int key = 0; key < int(N_NOTES); ++key)
+        {
+            corpus.render({key}, v, 0.5f);
+        }
+    }
+
+    // 最強打のクラスタ (低音/中音/高音)
+    printf("clusters\n");
+    for (int top : {0, 30, 60, 78})
+    {
+        std::vector<int> keys;
+        for (int i = 0; i < 10; ++i)
+        {
+            keys.push_back(top + i);
+        }
+        corpus.render(keys, 10.0f, 2.0f);
+    }
+}
+
+////
+
+struct Recommendation
+{
+    int headroom;          // 値域だけから見た余裕
+    int recommendedShift;  // 積の余裕も見たもの (0 以上)
+    int int16Shift;        // int32 型を int16 に詰める場合 (-1 なら入らない)
+    bool productOverflows; // シフトを 0 にしても溢れる積がある
+};
+
+// 型ごとにまず値域から余裕を求め、積 (被演算子の型の組) ごとに
+// 被演算子のシフトを増やした分の合計が積の余裕に収まるまで 1bit ずつ減らす
+// 増やす量の多い方から減らし、どちらも増やさなくなってもまだ足りなければ
+// (余裕の無い積) 不足は小数部の多い方の 1つにだけ課す
+// (結果の型の値域は profileShift で結果側の型に数えられている)
+std::map<const detail::FixedPointProfile*, Recommendation>
+recommend(int guardBits)
+{
+    std::map<const detail::FixedPointProfile*, Recommendation> r;
+    for (auto* p = detail::getFixedPointProfileList(); p; p = p->next)
+    {
+        int valueBits = detail::getBitLength(p->maxAbs);
+        int headroom  = p->bits - (p->isSigned ? 1 : 0) - valueBits;
+        if (p->overflow)
+        {
+            headroom = std::min(headroom, -1);
+        }
+        r[p] = {headroom,
+                std::max(0, p->shift + headroom - guardBits),
+                -1,
+                false};
+    }
+
+    // 1つを減らすと同じ型を使う別の積も変わるので落ち着くまで
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (auto* q = detail::getProductProfileList(); q; q = q->next)
+        {
+            if (!q->count)
+            {
+                continue;
+            }
+            auto& ra     = r[q->a];
+            auto& rb     = r[q->b];
+            auto growth  = [&](const Recommendation& t,
+                              const detail::FixedPointProfile* p) {
+                return t.recommendedShift - p->shift;
+            };
+            const int budget = q->headroom - guardBits;
+            while (growth(ra, q->a) + growth(rb, q->b) > budget)
+            {
+                int ga = growth(ra, q->a);
+                int gb = growth(rb, q->b);
+                auto* t = q->a->shift >= q->b->shift ? &ra : &rb;
+                if (ga > 0 || gb > 0)
+                {
+                    t = ga > gb ? &ra : &rb;
+                }
+                if (!t->recommendedShift)
+                {
+                    t = t == &ra ? &rb : &ra;
+                }
+                if (!t->recommendedShift)
+                {
+                    ra.productOverflows = rb.productOverflows = true;
+                    break;
+                }
+                --t->recommendedShift;
+                changed = true;
+            }
+        }
+    }
+
+    // int16 も同じ値域と積の余裕で、recommendedShift を超えない
+    for (auto& e : r)
+    {
+        auto* p        = e.first;
+        auto& rec      = e.second;
+        int intBits    = detail::getBitLength(p->maxAbs) - p->shift;
+        int fitShift   = 16 - (p->isSigned ? 1 : 0) - guardBits - intBits;
+        rec.int16Shift = fitShift < 0 ? -1
+                                      : std::min(fitShift,
+                                                 rec.recommendedShift);
+    }
+    return r;
+}
+
+std::string
+formatProfile(const detail::FixedPointProfile& p)
+{
+    char buf[256];
+    double maxAbs = ldexp((double)p.maxAbs, -p.shift);
+    double rms    = p.roundCount ? sqrt(p.sumRoundError2 / p.roundCount) : 0.0;
+    snprintf(buf,
+             sizeof(buf),
+             "n %llu, max|x| %.4g, ovf %llu/%llu, rms err %.3g, max err %.3g",
+             (unsigned long long)p.count,
+             maxAbs,
+             (unsigned long long)p.overflow,
+             (unsigned long long)p.productOverflow,
+             rms,
+             p.maxRoundError);
+    return buf;
+}
+
+const detail::FixedPointProfile*
+findProfile(int bits, bool isSigned, int shift)
+{
+    for (auto* p = detail::getFixedPointProfileList(); p; p = p->next)
+    {
+        if (p->bits == bits && p->isSigned == isSigned && p->shift == shift)
+        {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+void
+report(FILE* header, int guardBits)
+{
+    fprintf(header,
+            "/*\n"
+            " * generated by tools/qformat_tune.cpp (guard %d bit)\n"
+            " * 現行の typedef と diff を取って比較する。\n"
+            " * madd/nmsub の累算型 (FilterHistoryT 等) は被演算子の "
+            "シフト和に揃える必要がある。\n"
+            " */\n"
+            "#ifndef PM_PIANO_QFORMAT_TUNED_H\n"
+            "#define PM_PIANO_QFORMAT_TUNED_H\n\n"
+            "#include <pm_piano/fixed.h>\n\n"
+            "namespace physical_modeling_piano\n{\n"
+            "namespace qformat_tuned\n{\n",
+            guardBits);
+
+    const auto recs = recommend(guardBits);
+
+    // "!": シフトを 0 にしても溢れる積がある (mulWide にする)
+    printf("\n%-34s %-26s %5s %5s %5s  %s\n",
+           "typedef",
+           "current",
+           "room",
+           "rec",
+           "i16",
+           "stats");
+
+    for (auto& e : getTypedefs())
+    {
+        auto* p          = findProfile(e.bits, e.isSigned, e.shift);
+        auto typeName    = getTypeName(e.bits, e.isSigned);
+        std::string name = std::string(e.owner) + "::" + e.name;
+
+        if (!p || !p->count)
+        {
+            printf("%-34s FixedPoint<%s, %d>  (unused in corpus)\n",
+                   name.c_str(),
+                   typeName,
+                   e.shift);
+            fprintf(header,
+                    "// %s: unused in corpus\n"
+                    "using %s_%s = FixedPoint<%s, %d>;\n\n",
+                    name.c_str(),
+                    e.owner,
+                    e.name,
+                    typeName,
+                    e.shift);
+            continue;
+        }
+
+        auto& r   = recs.at(p);
+        auto info = formatProfile(*p);
+        // i16 は入らなければ "-"
+        char i16[8];
+        snprintf(i16, sizeof(i16), "%d", e.bits > 16 ? r.int16Shift : e.shift);
+        printf("%-34s FixedPoint<%s, %2d> %5d %5d %5s%s %s\n",
+               name.c_str(),
+               typeName,
+               e.shift,
+               r.headroom,
+               r.recommendedShift,
+               e.bits > 16 && r.int16Shift < 0 ? "-" : i16,
+               r.productOverflows ? "!" : " ",
+               info.c_str());
+
+        fprintf(header,
+                "// %s: current FixedPoint<%s, %d>, headroom %d bit\n"
+                "//   %s\n",
+                name.c_str(),
+                typeName,
+                e.shift,
+                r.headroom,
+                info.c_str());
+        if (r.productOverflows)
+        {
+            fprintf(header,
+                    "//   product overflows even at shift 0: "
+                    "widen the multiply (mulWide)\n");
+        }
+        if (e.bits > 16 && r.int16Shift >= 0)
+        {
+            fprintf(header,
+                    "//   int16 candidate: FixedPoint<int16_t, %d> "
+                    "(%d fraction bits lost)\n",
+                    r.int16Shift,
+                    r.recommendedShift - r.int16Shift);
+        }
+        fprintf(header,
+                "using %s_%s = FixedPoint<%s, %d>;\n\n",
+                e.owner,
+                e.name,
+                typeName,
+                r.recommendedShift);
+    }
+
+    // typedef 経由でない型 (Note 内部の一時変数など)
+    printf("\nuntyped:\n");
+    for (auto* p = detail::getFixedPointProfileList(); p; p = p->next)
+    {
+        bool found = false;
+        for (auto& e : getTypedefs())
+        {
+            found |= e.bits == p->bits && e.isSigned == p->isSigned &&
+                     e.shift == p->shift;
+        }
+        if (!found && p->count)
+        {
+            auto& r = recs.at(p);
+            printf("  FixedPoint<%s, %2d> room %d rec %d%s %s\n",
+                   getTypeName(p->bits, p->isSigned),
+                   p->shift,
+                   r.headroom,
+                   r.recommendedShift,
+                   r.productOverflows ? "!" : " ",
+                   formatProfile(*p).c_str());
+        }
+    }
+
+    // 被演算子の型の組ごとの積
+    printf("\nproducts:\n");
+    for (auto* q = detail::getProductProfileList(); q; q = q->next)
+    {
+        if (q->count)
+        {
+            printf("  FixedPoint<%s, %2d> * FixedPoint<%s, %2d> -> int%d: "
+                   "room %d, ovf %llu/%llu\n",
+                   getTypeName(q->a->bits, q->a->isSigned),
+                   q->a->shift,
+                   getTypeName(q->b->bits, q->b->isSigned),
+                   q->b->shift,
+                   q->bits,
+                   q->headroom,
+                   (unsigned long long)q->overflow,
+                   (unsigned long long)q->count);
+        }
+    }
+
+    fprintf(header,
+            "} // namespace qformat_tuned\n"
+            "} // namespace physical_modeling_piano\n\n"
+            "#endif /* PM_PIANO_QFORMAT_TUNED_H */\n");
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    const char* outName = argc > 1 ? argv[1] : "qformat_tuned.h";
+    int guardBits       = argc > 2 ? atoi(argv[2]) : 1;
+
+    renderStressCorpus();
+
+    FILE* fp = fopen(outName, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "can't open %s\n", outName);
+        return 1;
+    }
+    report(fp, guardBits);
+    fclose(fp);
+
+    printf("\nwrote %s\n", outName);
+    return 0;
+}